@@ -219,10 +219,20 @@ const app = (() => {
   }
   
   let fanoSocket = null;
+  let fanoLastSeq = 0;
+  let fanoLastChunk = -1;
+  
+  // After a drop, pick up where we left off: by event seq for JSON, by chunk for fano-bin.
+  function fanoResumeQuery() {
+    if (fanoLastSeq > 0) return `?from=${fanoLastSeq}`;
+    if (fanoLastChunk >= 0) return `?chunk=${fanoLastChunk}`;
+    return '';
+  }
   
   function connectToFanoServer() {
     try {
-      fanoSocket = new WebSocket('ws://localhost:8081', 'fano-protocol');
+      fanoSocket = new WebSocket(`ws://localhost:8081/${fanoResumeQuery()}`, ['fano-bin', 'fano-protocol']);
+      fanoSocket.binaryType = 'arraybuffer';
       
       fanoSocket.onopen = () => {
         addLog('Connected to Fano C Server', 'system');
@@ -231,20 +241,10 @@ const app = (() => {
       
       fanoSocket.onmessage = (e) => {
         try {
-          const data = JSON.parse(e.data);
-          
-          if (data.type === 'canon' || data.type === 'matrix') {
-            if (epistemicSquare && data.matrix) {
-              epistemicSquare.setMatrix(data.matrix);
-              epistemicSquare.setAngle(data.angle);
-            }
-            
-            const statusEl = document.getElementById('canon-status');
-            if (statusEl) statusEl.textContent = `Chunk ${data.chunk || 0}`;
-          }
-          else if (data.type === 'status') {
-            const statusEl = document.getElementById('canon-status');
-            if (statusEl) statusEl.textContent = data.playing ? 'Playing' : 'Ready';
+          if (e.data instanceof ArrayBuffer) {
+            decodeFanoBin(e.data).forEach(handleFanoMessage);
+          } else {
+            handleFanoMessage(JSON.parse(e.data));
           }
         } catch (err) {
           console.error('WS parse error:', err);
@@ -264,6 +264,55 @@ const app = (() => {
     }
   }
   
+  function handleFanoMessage(data) {
+    if (data.seq) fanoLastSeq = data.seq;
+    if (data.type === 'canon' && data.chunk !== undefined) fanoLastChunk = data.chunk;
+    if (data.type === 'canon' || data.type === 'matrix') {
+      if (epistemicSquare && data.matrix) {
+        epistemicSquare.setMatrix(data.matrix);
+        epistemicSquare.setAngle(data.angle);
+      }
+      
+      const statusEl = document.getElementById('canon-status');
+      if (statusEl) statusEl.textContent = `Chunk ${data.chunk || 0}`;
+    }
+    else if (data.type === 'status') {
+      const statusEl = document.getElementById('canon-status');
+      if (statusEl) statusEl.textContent = data.playing ? 'Playing' : 'Ready';
+    }
+  }
+  
+  // fano-bin: 8-byte header ("FB", version, type, u16 count) then 12-byte records.
+  function decodeFanoBin(buffer) {
+    const view = new DataView(buffer);
+    if (view.byteLength < 8 || view.getUint8(0) !== 0x46 || view.getUint8(1) !== 0x42) return [];
+    const type = view.getUint8(3);
+    const count = view.getUint16(4, true);
+    const messages = [];
+    for (let i = 0; i < count && 8 + (i + 1) * 12 <= view.byteLength; i++) {
+      const at = 8 + i * 12;
+      if (type === 0) {
+        const packed = view.getUint16(at + 4, true);
+        messages.push({
+          type: 'canon',
+          chunk: view.getUint32(at, true),
+          matrix: Array.from({length: 7}, (_, p) => (packed >> (p * 2)) & 3),
+          angle: view.getUint16(at + 6, true) * 360 / 65536,
+          seed: view.getUint32(at + 8, true)
+        });
+      } else if (type === 1) {
+        messages.push({
+          type: 'status',
+          chunks: view.getUint32(at, true),
+          current: view.getUint32(at + 4, true),
+          speed: view.getUint16(at + 8, true) / 100,
+          playing: view.getUint8(at + 10)
+        });
+      }
+    }
+    return messages;
+  }
+  
   function connectNetwork() {
     if (typeof NETWORK !== 'undefined') {
       NETWORK.init();
@@ -0,0 +1,103 @@
+#include "arena.h"
+#include "memory_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static MemoryPool* class_pools[ARENA_CLASSES];
+static const char* class_names[ARENA_CLASSES] = {
+    "class-64", "class-128", "class-256", "class-512", "class-1k", "class-2k",
+    "class-4k", "class-8k", "class-16k", "class-32k", "class-64k"
+};
+
+int arena_init(void) {
+    for (int i = 0; i < ARENA_CLASSES; i++) {
+        size_t size = (size_t)1 << (ARENA_MIN_SHIFT + i);
+        class_pools[i] = pool_create(class_names[i], size, ARENA_SLAB_BYTES / size, POOL_GROW);
+        if (!class_pools[i]) return -1;
+    }
+    return 0;
+}
+
+void arena_shutdown(void) {
+    for (int i = 0; i < ARENA_CLASSES; i++) {
+        pool_destroy(class_pools[i]);
+        class_pools[i] = NULL;
+    }
+}
+
+static int class_index(size_t size) {
+    int shift = ARENA_MIN_SHIFT;
+    while (((size_t)1 << shift) < size) shift++;
+    return shift - ARENA_MIN_SHIFT;
+}
+
+/*
+ * At least size bytes; *capacity is what was actually given and what
+ * arena_class_free wants back. A block that had to come from malloc gets
+ * an odd capacity, so it can never be mistaken for a class block and
+ * handed to pool_free.
+ */
+void* arena_class_alloc(size_t size, size_t* capacity) {
+    int index = class_index(size);
+    if (index < ARENA_CLASSES && class_pools[index]) {
+        void* block = pool_alloc(class_pools[index]);
+        if (block) {
+            *capacity = (size_t)1 << (ARENA_MIN_SHIFT + index);
+            return block;
+        }
+    }
+    *capacity = size | 1;
+    return malloc(*capacity);
+}
+
+void arena_class_free(void* block, size_t capacity) {
+    if (!block) return;
+    if (capacity & 1) {
+        free(block);
+        return;
+    }
+    int index = class_index(capacity);
+    if (index < ARENA_CLASSES && class_pools[index] &&
+        capacity == (size_t)1 << (ARENA_MIN_SHIFT + index)) {
+        pool_free(class_pools[index], block);
+    } else {
+        free(block);
+    }
+}
+
+/* 16-byte aligned and uninitialised; NULL when memory runs out. */
+void* arena_alloc(Arena* arena, size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    ArenaChunk* chunk = arena->head;
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t want = sizeof(ArenaChunk) + size;
+        size_t capacity;
+        chunk = arena_class_alloc(want > ARENA_CHUNK ? want : ARENA_CHUNK, &capacity);
+        if (!chunk) return NULL;
+        chunk->capacity = capacity;
+        chunk->size = capacity - sizeof(ArenaChunk);
+        chunk->used = 0;
+        /* A one-off large chunk goes behind the current one so its free space stays in use. */
+        if (arena->head && size > ARENA_CHUNK / 2) {
+            chunk->next = arena->head->next;
+            arena->head->next = chunk;
+        } else {
+            chunk->next = arena->head;
+            arena->head = chunk;
+        }
+    }
+    void* out = (char*)(chunk + 1) + chunk->used;
+    chunk->used += size;
+    return out;
+}
+
+void arena_reset(Arena* arena) {
+    ArenaChunk* chunk = arena->head;
+    while (chunk) {
+        ArenaChunk* next = chunk->next;
+        arena_class_free(chunk, chunk->capacity);
+        chunk = next;
+    }
+    arena->head = NULL;
+}
@@ -0,0 +1,41 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ARENA_MIN_SHIFT 6                      /* 64-byte smallest class */
+#define ARENA_MAX_SHIFT 16                     /* 64 KiB largest class */
+#define ARENA_CLASSES (ARENA_MAX_SHIFT - ARENA_MIN_SHIFT + 1)
+#define ARENA_SLAB_BYTES (256 * 1024)
+#define ARENA_CHUNK 4096
+
+/*
+ * Power-of-two size classes over memory_pool, one pool per class, for
+ * buffers that grow and shrink with a connection (arena_class_alloc) and
+ * for per-request scratch (Arena). Sizes past the largest class go to
+ * malloc. An Arena bumps through chunks taken from the classes and gives
+ * them all back at once with arena_reset; nothing allocated from it is
+ * freed on its own.
+ */
+typedef struct ArenaChunk {
+    struct ArenaChunk* next;
+    size_t size;
+    size_t used;
+    size_t capacity;
+} ArenaChunk;
+
+typedef struct {
+    ArenaChunk* head;
+} Arena;
+
+int arena_init(void);
+void arena_shutdown(void);
+
+void* arena_class_alloc(size_t size, size_t* capacity);
+void arena_class_free(void* block, size_t capacity);
+
+void* arena_alloc(Arena* arena, size_t size);
+void arena_reset(Arena* arena);
+
+#endif
@@ -0,0 +1,207 @@
+#include "asset_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#define ASSET_WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM)
+
+static uint64_t fnv1a64(const char* data, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static AssetBlob* blob_load(const AssetRoute* route) {
+    FILE* file = fopen(route->file, "rb");
+    if (!file) return NULL;
+    
+    struct stat st;
+    if (fstat(fileno(file), &st) < 0 || !S_ISREG(st.st_mode)) {
+        fclose(file);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    
+    AssetBlob* blob = calloc(1, sizeof(AssetBlob));
+    if (!blob) {
+        fclose(file);
+        return NULL;
+    }
+    blob->body_len = size;
+    blob->header = malloc(512);
+    if (!blob->header) {
+        fclose(file);
+        free(blob);
+        return NULL;
+    }
+    
+    if (size > ASSET_INLINE_MAX) {
+        blob->streamed = 1;
+        snprintf(blob->etag, sizeof(blob->etag), "\"%llx-%zx\"",
+                 (unsigned long long)st.st_mtime, size);
+    } else {
+        blob->body = malloc(size > 0 ? size : 1);
+        if (!blob->body || fread(blob->body, 1, size, file) != size) {
+            fclose(file);
+            free(blob->body);
+            free(blob->header);
+            free(blob);
+            return NULL;
+        }
+        snprintf(blob->etag, sizeof(blob->etag), "\"%016llx-%zx\"",
+                 (unsigned long long)fnv1a64(blob->body, size), size);
+    }
+    fclose(file);
+    
+    /* Everything but the Connection header, which depends on the request. */
+    int header_len = snprintf(blob->header, 512,
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Length: %zu\r\n"
+        "ETag: %s\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Access-Control-Allow-Origin: *\r\n",
+        route->content_type, blob->body_len, blob->etag);
+    blob->header_len = (size_t)header_len;
+    atomic_init(&blob->refs, 1);
+    return blob;
+}
+
+void asset_blob_release(AssetBlob* blob) {
+    if (!blob) return;
+    if (atomic_fetch_sub_explicit(&blob->refs, 1, memory_order_acq_rel) == 1) {
+        free(blob->header);
+        free(blob->body);
+        free(blob);
+    }
+}
+
+static void entry_reload(AssetCache* cache, AssetEntry* entry) {
+    AssetBlob* fresh = blob_load(entry->route);
+    
+    pthread_mutex_lock(&cache->mutex);
+    AssetBlob* old = entry->blob;
+    entry->blob = fresh;
+    pthread_mutex_unlock(&cache->mutex);
+    
+    asset_blob_release(old);
+    if (fresh) {
+        printf("Asset cache: loaded %s (%zu bytes%s, %s)\n", entry->route->file, fresh->body_len,
+               fresh->streamed ? ", streamed" : "", fresh->etag);
+    } else {
+        printf("Asset cache: %s unavailable\n", entry->route->file);
+    }
+}
+
+static const char* base_name(const char* path) {
+    const char* slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static void* asset_watch_thread(void* arg) {
+    AssetCache* cache = (AssetCache*)arg;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    
+    while (cache->running) {
+        struct pollfd pfd = { .fd = cache->inotify_fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, 1000);
+        if (ready <= 0) continue;
+        
+        ssize_t len = read(cache->inotify_fd, buf, sizeof(buf));
+        if (len <= 0) {
+            if (len < 0 && errno == EINTR) continue;
+            break;
+        }
+        
+        for (char* p = buf; p < buf + len; ) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            if (!ev->len) continue;
+            
+            for (size_t i = 0; i < cache->count; i++) {
+                AssetEntry* entry = &cache->entries[i];
+                if (entry->watch_fd == ev->wd && strcmp(base_name(entry->route->file), ev->name) == 0) {
+                    entry_reload(cache, entry);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+static int watch_directory(AssetCache* cache, const char* file) {
+    char dir[256];
+    const char* slash = strrchr(file, '/');
+    if (slash) {
+        size_t n = (size_t)(slash - file);
+        if (n >= sizeof(dir)) n = sizeof(dir) - 1;
+        memcpy(dir, file, n);
+        dir[n] = '\0';
+    } else {
+        strcpy(dir, ".");
+    }
+    /* inotify hands back the same descriptor when a directory is watched twice. */
+    return inotify_add_watch(cache->inotify_fd, dir, ASSET_WATCH_EVENTS);
+}
+
+int asset_cache_init(AssetCache* cache, const AssetRoute* routes, size_t count) {
+    memset(cache, 0, sizeof(*cache));
+    cache->entries = calloc(count, sizeof(AssetEntry));
+    if (!cache->entries) return -1;
+    cache->count = count;
+    pthread_mutex_init(&cache->mutex, NULL);
+    
+    cache->inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (cache->inotify_fd < 0) {
+        fprintf(stderr, "Asset cache: inotify unavailable, edits need a restart\n");
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        AssetEntry* entry = &cache->entries[i];
+        entry->route = &routes[i];
+        entry->blob = blob_load(entry->route);
+        entry->watch_fd = cache->inotify_fd >= 0 ? watch_directory(cache, entry->route->file) : -1;
+    }
+    
+    if (cache->inotify_fd >= 0) {
+        cache->running = 1;
+        if (pthread_create(&cache->watch_thread, NULL, asset_watch_thread, cache) != 0) {
+            cache->running = 0;
+        }
+    }
+    return 0;
+}
+
+void asset_cache_shutdown(AssetCache* cache) {
+    if (cache->running) {
+        cache->running = 0;
+        pthread_join(cache->watch_thread, NULL);
+    }
+    if (cache->inotify_fd >= 0) close(cache->inotify_fd);
+    
+    for (size_t i = 0; i < cache->count; i++) {
+        asset_blob_release(cache->entries[i].blob);
+    }
+    free(cache->entries);
+    cache->entries = NULL;
+    cache->count = 0;
+    pthread_mutex_destroy(&cache->mutex);
+}
+
+AssetBlob* asset_cache_acquire(AssetCache* cache, int index) {
+    if (index < 0 || (size_t)index >= cache->count) return NULL;
+    
+    pthread_mutex_lock(&cache->mutex);
+    AssetBlob* blob = cache->entries[index].blob;
+    if (blob) atomic_fetch_add_explicit(&blob->refs, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&cache->mutex);
+    return blob;
+}
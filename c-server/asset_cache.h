@@ -0,0 +1,53 @@
+#ifndef ASSET_CACHE_H
+#define ASSET_CACHE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define ASSET_MAX_ALIASES 3
+#define ASSET_INLINE_MAX (256 * 1024)
+
+typedef struct {
+    const char* paths[ASSET_MAX_ALIASES];
+    const char* file;
+    const char* content_type;
+} AssetRoute;
+
+/*
+ * Immutable snapshot of one file; stays valid while a reference is held.
+ * Files above ASSET_INLINE_MAX are not held in memory (streamed is set and
+ * body is NULL) and go out through the sendfile path instead.
+ */
+typedef struct {
+    atomic_int refs;
+    uint8_t streamed;
+    char* header;
+    size_t header_len;
+    char* body;
+    size_t body_len;
+    char etag[40];
+} AssetBlob;
+
+typedef struct {
+    const AssetRoute* route;
+    AssetBlob* blob;
+    int watch_fd;
+} AssetEntry;
+
+typedef struct {
+    AssetEntry* entries;
+    size_t count;
+    pthread_mutex_t mutex;
+    int inotify_fd;
+    volatile uint8_t running;
+    pthread_t watch_thread;
+} AssetCache;
+
+int asset_cache_init(AssetCache* cache, const AssetRoute* routes, size_t count);
+void asset_cache_shutdown(AssetCache* cache);
+AssetBlob* asset_cache_acquire(AssetCache* cache, int index);
+void asset_blob_release(AssetBlob* blob);
+
+#endif
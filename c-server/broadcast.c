@@ -0,0 +1,293 @@
+#include "broadcast.h"
+#include "memory_pool.h"
+#include "router.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+static const char* event_names[] = { "canon", "status" };
+static _Atomic uint64_t frame_seq = 0;
+static MemoryPool* frame_pool = NULL;
+
+/* Room for the ring plus what clients still hold; grows past that. */
+int broadcast_init(void) {
+    frame_pool = pool_create("frames", BROADCAST_FRAME_BLOCK, BROADCAST_RING_SIZE, POOL_GROW);
+    return frame_pool ? 0 : -1;
+}
+
+/* After the last frame is released. */
+void broadcast_shutdown(void) {
+    pool_destroy(frame_pool);
+    frame_pool = NULL;
+}
+
+static void put_u16(unsigned char* out, uint16_t v) {
+    out[0] = (unsigned char)v;
+    out[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char* out, uint32_t v) {
+    out[0] = (unsigned char)v;
+    out[1] = (unsigned char)(v >> 8);
+    out[2] = (unsigned char)(v >> 16);
+    out[3] = (unsigned char)(v >> 24);
+}
+
+void broadcast_bin_header(unsigned char* out, uint8_t type, uint16_t count) {
+    out[0] = 'F';
+    out[1] = 'B';
+    out[2] = BROADCAST_BIN_VERSION;
+    out[3] = type;
+    put_u16(out + 4, count);
+    put_u16(out + 6, 0);
+}
+
+/* The fano-bin canon record for one row of the store. */
+void broadcast_bin_canon_record(unsigned char* out, const CanonStore* store, uint32_t index) {
+    put_u32(out, index);
+    put_u16(out + 4, store->matrix[index]);
+    put_u16(out + 6, store->angle[index]);
+    put_u32(out + 8, store->seed[index]);
+}
+
+/*
+ * Lays out [LWS_PRE][json\0][id: <seq>\nevent: <type>\ndata: json\n\n\0][LWS_PRE][bin]
+ * in one block.
+ */
+static BroadcastFrame* frame_build(uint8_t type, uint64_t seq, const char* session, uint32_t chunk,
+                                   uint32_t interest, const char* json, int json_len,
+                                   const unsigned char record[BROADCAST_BIN_RECORD]) {
+    if (json_len <= 0) return NULL;
+    const char* event = event_names[type];
+    char id[32];
+    int id_len = snprintf(id, sizeof(id), "%lu", (unsigned long)seq);
+    size_t sse_len = 4 + (size_t)id_len + 8 + strlen(event) + 7 + (size_t)json_len + 2;
+    size_t bin_len = BROADCAST_BIN_HEADER + BROADCAST_BIN_RECORD;
+    
+    size_t size = sizeof(BroadcastFrame) + LWS_PRE + (size_t)json_len + 1 + sse_len + 1 + LWS_PRE + bin_len;
+    BroadcastFrame* frame = frame_pool && size <= BROADCAST_FRAME_BLOCK ? pool_alloc(frame_pool) : NULL;
+    int pooled = frame != NULL;
+    if (!frame) frame = malloc(size);
+    if (!frame) return NULL;
+    atomic_init(&frame->refs, 1);
+    frame->pooled = (uint8_t)pooled;
+    frame->seq = seq;
+    frame->type = type;
+    frame->chunk = chunk;
+    frame->interest = interest;
+    frame->session_hash = broadcast_session_hash(session);
+    snprintf(frame->session, sizeof(frame->session), "%s", session);
+    
+    frame->json = frame->data + LWS_PRE;
+    frame->json_len = (size_t)json_len;
+    memcpy(frame->json, json, (size_t)json_len + 1);
+    
+    char* sse = (char*)frame->json + json_len + 1;
+    snprintf(sse, sse_len + 1, "id: %s\nevent: %s\ndata: %s\n\n", id, event, json);
+    frame->sse = sse;
+    frame->sse_len = sse_len;
+    
+    frame->bin = (unsigned char*)sse + sse_len + 1 + LWS_PRE;
+    frame->bin_len = bin_len;
+    broadcast_bin_header(frame->bin, type, 1);
+    memcpy(frame->bin + BROADCAST_BIN_HEADER, record, BROADCAST_BIN_RECORD);
+    return frame;
+}
+
+/* changed_points has bit p set when Fano point p differs from what the session showed before. */
+BroadcastFrame* broadcast_canon(const char* session, const CanonStore* store, uint32_t index,
+                                uint8_t changed_points) {
+    uint8_t matrix[7];
+    canon_store_matrix(store, index, matrix);
+    uint64_t seq = atomic_fetch_add(&frame_seq, 1) + 1;
+    char json[512];
+    int len = snprintf(json, sizeof(json),
+        "{\"type\":\"canon\",\"seq\":%lu,\"session\":\"%s\",\"chunk\":%u,\"matrix\":[%d,%d,%d,%d,%d,%d,%d],\"angle\":%.2f}",
+        (unsigned long)seq, session, index,
+        matrix[0], matrix[1], matrix[2], matrix[3],
+        matrix[4], matrix[5], matrix[6], canon_store_angle(store, index));
+    if (len >= (int)sizeof(json)) return NULL;
+    
+    unsigned char record[BROADCAST_BIN_RECORD];
+    broadcast_bin_canon_record(record, store, index);
+    uint32_t interest = BROADCAST_EVENT_BIT(BROADCAST_CANON) | BROADCAST_POINT_ANY |
+                        ((uint32_t)(changed_points & 0x7F) << 8);
+    return frame_build(BROADCAST_CANON, seq, session, index, interest, json, len, record);
+}
+
+BroadcastFrame* broadcast_status(const char* session, uint32_t chunks, uint32_t current, uint8_t playing, float speed) {
+    uint64_t seq = atomic_fetch_add(&frame_seq, 1) + 1;
+    char json[256];
+    int len = snprintf(json, sizeof(json),
+        "{\"type\":\"status\",\"seq\":%lu,\"session\":\"%s\",\"chunks\":%u,\"current\":%u,\"playing\":%d,\"speed\":%.1f}",
+        (unsigned long)seq, session, chunks, current, playing, speed);
+    if (len >= (int)sizeof(json)) return NULL;
+    
+    unsigned char record[BROADCAST_BIN_RECORD];
+    float centi = speed * 100.0f + 0.5f;
+    put_u32(record, chunks);
+    put_u32(record + 4, current);
+    put_u16(record + 8, centi <= 0 ? 0 : centi >= 65535.0f ? 65535 : (uint16_t)centi);
+    record[10] = playing;
+    record[11] = 0;
+    uint32_t interest = BROADCAST_EVENT_BIT(BROADCAST_STATUS) | BROADCAST_POINTS_ALL | BROADCAST_POINT_ANY;
+    return frame_build(BROADCAST_STATUS, seq, session, current, interest, json, len, record);
+}
+
+/* FNV-1a; lets fan-out compare sessions as integers before comparing names. */
+uint32_t broadcast_session_hash(const char* session) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* c = (const unsigned char*)session; *c; c++) {
+        hash = (hash ^ *c) * 16777619u;
+    }
+    return hash;
+}
+
+void broadcast_retain(BroadcastFrame* frame) {
+    atomic_fetch_add_explicit(&frame->refs, 1, memory_order_relaxed);
+}
+
+void broadcast_release(BroadcastFrame* frame) {
+    if (!frame) return;
+    if (atomic_fetch_sub_explicit(&frame->refs, 1, memory_order_acq_rel) == 1) {
+        if (frame->pooled) pool_free(frame_pool, frame);
+        else free(frame);
+    }
+}
+
+void broadcast_release_owner(void* frame) {
+    broadcast_release((BroadcastFrame*)frame);
+}
+
+void broadcast_ring_init(BroadcastRing* ring) {
+    memset(ring, 0, sizeof(*ring));
+}
+
+void broadcast_ring_clear(BroadcastRing* ring) {
+    for (int i = 0; i < BROADCAST_RING_SIZE; i++) {
+        atomic_store(&ring->slots[i].seq, 0);
+        BroadcastFrame* frame = atomic_exchange(&ring->slots[i].frame, NULL);
+        while (frame && atomic_load(&ring->acquiring) != 0) {
+            sched_yield();
+        }
+        broadcast_release(frame);
+    }
+}
+
+/* Single producer. The ring keeps its own reference on frame. */
+void broadcast_ring_publish(BroadcastRing* ring, BroadcastFrame* frame) {
+    if (!frame) return;
+    BroadcastSlot* slot = &ring->slots[frame->seq & (BROADCAST_RING_SIZE - 1)];
+    broadcast_retain(frame);
+    atomic_store(&slot->seq, 0);
+    BroadcastFrame* evicted = atomic_exchange(&slot->frame, frame);
+    atomic_store(&slot->seq, frame->seq);
+    atomic_store_explicit(&ring->head, frame->seq, memory_order_release);
+    
+    if (evicted) {
+        /* A reader that saw evicted may still be about to take its reference. */
+        while (atomic_load(&ring->acquiring) != 0) {
+            sched_yield();
+        }
+        broadcast_release(evicted);
+    }
+}
+
+/* Takes a reference on frame seq, or NULL when it is gone or never arrived. */
+BroadcastFrame* broadcast_ring_acquire(BroadcastRing* ring, uint64_t seq) {
+    BroadcastSlot* slot = &ring->slots[seq & (BROADCAST_RING_SIZE - 1)];
+    BroadcastFrame* frame = NULL;
+    atomic_fetch_add(&ring->acquiring, 1);
+    if (seq != 0 && atomic_load(&slot->seq) == seq) {
+        frame = atomic_load(&slot->frame);
+        if (frame && atomic_load(&slot->seq) == seq) {
+            broadcast_retain(frame);
+        } else {
+            frame = NULL;
+        }
+    }
+    atomic_fetch_sub(&ring->acquiring, 1);
+    return frame;
+}
+
+/* Oldest seq that can still be in the ring when head is the newest. */
+static uint64_t ring_floor(uint64_t head) {
+    return head > BROADCAST_RING_SIZE ? head - BROADCAST_RING_SIZE + 1 : 1;
+}
+
+/*
+ * Scans back from head for the newest canon and status frames of session.
+ * Fills seqs in publish order and returns how many were found.
+ */
+int broadcast_ring_latest(BroadcastRing* ring, const char* session, uint64_t head, uint64_t seqs[2]) {
+    uint64_t found[2] = {0, 0};
+    for (uint64_t seq = head; seq >= ring_floor(head) && seq > 0 && !(found[0] && found[1]); seq--) {
+        BroadcastFrame* frame = broadcast_ring_acquire(ring, seq);
+        if (!frame) continue;
+        if (!found[frame->type] && strcmp(frame->session, session) == 0) found[frame->type] = seq;
+        broadcast_release(frame);
+    }
+    
+    int count = 0;
+    if (found[0] && found[1] && found[1] < found[0]) {
+        seqs[count++] = found[1];
+        seqs[count++] = found[0];
+    } else {
+        if (found[0]) seqs[count++] = found[0];
+        if (found[1]) seqs[count++] = found[1];
+    }
+    return count;
+}
+
+/* seq of the newest canon frame of session for chunk, 0 when it has left the ring. */
+uint64_t broadcast_ring_find_chunk(BroadcastRing* ring, const char* session, uint32_t chunk, uint64_t head) {
+    for (uint64_t seq = head; seq >= ring_floor(head) && seq > 0; seq--) {
+        BroadcastFrame* frame = broadcast_ring_acquire(ring, seq);
+        if (!frame) continue;
+        int match = frame->type == BROADCAST_CANON && frame->chunk == chunk &&
+                    strcmp(frame->session, session) == 0;
+        broadcast_release(frame);
+        if (match) return seq;
+    }
+    return 0;
+}
+
+void broadcast_resume_parse(const char* query, BroadcastResumeRequest* request) {
+    const char* value;
+    if (!query) return;
+    if ((value = query_param(query, "from", NULL)) != NULL) {
+        request->resuming = 1;
+        request->from = strtoull(value, NULL, 10);
+    }
+    if ((value = query_param(query, "chunk", NULL)) != NULL) {
+        request->by_chunk = 1;
+        request->chunk = (uint32_t)strtoul(value, NULL, 10);
+    }
+    if ((value = query_param(query, "compact", NULL)) != NULL) {
+        request->compact = *value == '1';
+    }
+}
+
+void broadcast_resume_plan(BroadcastRing* ring, const char* session, uint64_t head,
+                           const BroadcastResumeRequest* request, BroadcastResume* resume) {
+    uint64_t from = request->from;
+    int resuming = request->resuming;
+    if (request->by_chunk) {
+        uint64_t seq = broadcast_ring_find_chunk(ring, session, request->chunk, head);
+        resuming = seq != 0;
+        from = seq ? seq - 1 : 0;
+    }
+    
+    resume->read_seq = head;
+    resume->snapshot_count = 0;
+    /* Ids from before a restart are ahead of the log; start those over. */
+    if (resuming && from > head) resuming = 0;
+    if (resuming && from == head) return;
+    if (resuming && !request->compact && head - from <= BROADCAST_REPLAY_MAX &&
+        from + 1 >= ring_floor(head)) {
+        resume->read_seq = from;
+        return;
+    }
+    resume->snapshot_count = broadcast_ring_latest(ring, session, head, resume->snapshot);
+}
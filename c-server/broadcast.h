@@ -0,0 +1,162 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <libwebsockets.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "canon_store.h"
+
+#define BROADCAST_SESSION_MAX 32
+#define BROADCAST_RING_SIZE 4096
+#define BROADCAST_REPLAY_MAX 256
+#define BROADCAST_FRAME_BLOCK 1024
+
+/*
+ * fano-bin wire format, little-endian: an 8-byte header ("FB", version,
+ * BroadcastType, u16 record count, u16 reserved) followed by count fixed 12-byte
+ * records. A canon record is u32 chunk index, u16 packed matrix (seven
+ * 2-bit quadrants, point 0 in the low bits), u16 angle scaled to the full
+ * u16 turn and u32 seed. A status record is u32 chunks, u32 current,
+ * u16 speed in hundredths and u8 playing.
+ */
+#define BROADCAST_BIN_VERSION 1
+#define BROADCAST_BIN_HEADER 8
+#define BROADCAST_BIN_RECORD 12
+
+typedef enum {
+    BROADCAST_CANON = 0,
+    BROADCAST_STATUS = 1
+} BroadcastType;
+
+/*
+ * Interest masks. A frame's mask has its event type bit, one bit per Fano
+ * point it concerns and BROADCAST_POINT_ANY; a subscriber's has the types
+ * it wants and either the points it follows or BROADCAST_POINT_ANY for all
+ * of them. A single AND then tells whether anything overlaps, see
+ * broadcast_interested.
+ */
+#define BROADCAST_EVENT_BIT(type) (1u << (type))
+#define BROADCAST_EVENTS_ALL 0x000000FFu
+#define BROADCAST_POINT_BIT(point) (1u << (8 + (point)))
+#define BROADCAST_POINTS_ALL 0x00007F00u
+#define BROADCAST_POINT_ANY 0x00008000u
+
+/*
+ * One event, encoded once and shared by every transport and every client.
+ * The JSON payload sits LWS_PRE bytes into data so lws_write can put the
+ * frame header in front of it without copying; the SSE text follows it
+ * already framed, then the fano-bin message with its own LWS_PRE headroom.
+ * seq numbers frames in the order they were built, starting at 1; it is
+ * the SSE event id. Frames are immutable once built and freed with their
+ * last reference, whichever thread drops it; frames up to
+ * BROADCAST_FRAME_BLOCK bytes come from a shared pool.
+ */
+typedef struct {
+    atomic_int refs;
+    uint64_t seq;
+    uint8_t type;
+    uint8_t pooled;
+    uint32_t chunk;
+    uint32_t interest;
+    uint32_t session_hash;
+    char session[BROADCAST_SESSION_MAX];
+    unsigned char* json;
+    size_t json_len;
+    const char* sse;
+    size_t sse_len;
+    unsigned char* bin;
+    size_t bin_len;
+    unsigned char data[];
+} BroadcastFrame;
+
+typedef struct {
+    _Atomic uint64_t seq;
+    _Atomic(BroadcastFrame*) frame;
+} BroadcastSlot;
+
+/*
+ * Recent frames indexed by seq, for readers that each keep their own
+ * position; the server keeps one as the event log every transport reads
+ * and replays from. One thread publishes; any number read. A slot's seq is set
+ * once its frame is in place and cleared while it is replaced, so a
+ * reader can tell whether the frame it picked up is the one it asked for.
+ * The ring holds a reference on every frame it contains; readers take
+ * their own under acquiring, and the publisher waits for that to drain
+ * before dropping the frame it evicted, as canon snapshots do.
+ */
+typedef struct {
+    BroadcastSlot slots[BROADCAST_RING_SIZE];
+    _Atomic uint64_t head;
+    atomic_uint acquiring;
+} BroadcastRing;
+
+/*
+ * What a joining client asked for: to resume after event seq from
+ * (?from=N, or SSE's Last-Event-ID), to resume at the newest event for
+ * chunk (?chunk=N), and whether it only wants the current state
+ * (?compact=1).
+ */
+typedef struct {
+    uint8_t resuming;
+    uint8_t by_chunk;
+    uint8_t compact;
+    uint64_t from;
+    uint32_t chunk;
+} BroadcastResumeRequest;
+
+/*
+ * Where a joining client starts. When the missed events are few enough
+ * they are replayed raw from after read_seq; otherwise read_seq is the
+ * head and the client first gets snapshot, the newest canon and status
+ * frames of its session, which together are the whole playback state.
+ */
+typedef struct {
+    uint64_t read_seq;
+    uint64_t snapshot[2];
+    int snapshot_count;
+} BroadcastResume;
+
+int broadcast_init(void);
+void broadcast_shutdown(void);
+
+BroadcastFrame* broadcast_canon(const char* session, const CanonStore* store, uint32_t index,
+                                uint8_t changed_points);
+BroadcastFrame* broadcast_status(const char* session, uint32_t chunks, uint32_t current, uint8_t playing, float speed);
+void broadcast_bin_header(unsigned char* out, uint8_t type, uint16_t count);
+void broadcast_bin_canon_record(unsigned char* out, const CanonStore* store, uint32_t index);
+static inline const unsigned char* broadcast_bin_record(const BroadcastFrame* frame) {
+    return frame->bin + BROADCAST_BIN_HEADER;
+}
+
+uint32_t broadcast_session_hash(const char* session);
+
+static inline int broadcast_interested(uint32_t frame_interest, uint32_t subscriber_interest) {
+    uint32_t hit = frame_interest & subscriber_interest;
+    return (hit & BROADCAST_EVENTS_ALL) && (hit & (BROADCAST_POINTS_ALL | BROADCAST_POINT_ANY));
+}
+
+void broadcast_retain(BroadcastFrame* frame);
+void broadcast_release(BroadcastFrame* frame);
+
+/* Release callback shape used by outq_push_ref. */
+void broadcast_release_owner(void* frame);
+
+void broadcast_ring_init(BroadcastRing* ring);
+void broadcast_ring_clear(BroadcastRing* ring);
+void broadcast_ring_publish(BroadcastRing* ring, BroadcastFrame* frame);
+BroadcastFrame* broadcast_ring_acquire(BroadcastRing* ring, uint64_t seq);
+
+int broadcast_ring_latest(BroadcastRing* ring, const char* session, uint64_t head, uint64_t seqs[2]);
+uint64_t broadcast_ring_find_chunk(BroadcastRing* ring, const char* session, uint32_t chunk, uint64_t head);
+
+void broadcast_resume_parse(const char* query, BroadcastResumeRequest* request);
+void broadcast_resume_plan(BroadcastRing* ring, const char* session, uint64_t head,
+                           const BroadcastResumeRequest* request, BroadcastResume* resume);
+
+/* seq of the newest published frame, 0 before the first. */
+static inline uint64_t broadcast_ring_head(BroadcastRing* ring) {
+    return atomic_load_explicit(&ring->head, memory_order_acquire);
+}
+
+#endif
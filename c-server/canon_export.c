@@ -0,0 +1,219 @@
+#include "canon_export.h"
+#include "broadcast.h"
+#include <string.h>
+
+#define EXPORT_ROW_FIXED 256             /* a line without its strings and record */
+#define EXPORT_BIN_BATCH 65535           /* records in one fano-bin message */
+
+static const struct {
+    const char* name;
+    uint32_t bit;
+} FIELD_NAMES[] = {
+    {"matrix", CANON_FIELD_MATRIX},
+    {"angle", CANON_FIELD_ANGLE},
+    {"seed", CANON_FIELD_SEED},
+    {"timestamp", CANON_FIELD_TIMESTAMP},
+    {"event", CANON_FIELD_EVENT},
+    {"article", CANON_FIELD_ARTICLE},
+    {"id", CANON_FIELD_ID},
+    {"chapter", CANON_FIELD_CHAPTER},
+    {"verse", CANON_FIELD_VERSE},
+    {"record", CANON_FIELD_RECORD},
+};
+
+#define FIELD_COUNT (sizeof(FIELD_NAMES) / sizeof(FIELD_NAMES[0]))
+
+/* Comma-separated field names to a mask; 0 if any name is unknown. */
+uint32_t canon_export_fields(const char* list, size_t len) {
+    uint32_t fields = 0;
+    size_t at = 0;
+    while (at < len) {
+        size_t end = at;
+        while (end < len && list[end] != ',') end++;
+        size_t i = 0;
+        while (i < FIELD_COUNT && (strlen(FIELD_NAMES[i].name) != end - at ||
+                                   memcmp(FIELD_NAMES[i].name, list + at, end - at) != 0)) i++;
+        if (i == FIELD_COUNT) return 0;
+        fields |= FIELD_NAMES[i].bit;
+        at = end + 1;
+    }
+    return fields;
+}
+
+/* to is exclusive; both ends are clamped to the store. */
+void canon_export_begin(CanonExport* ex, const CanonStore* store, size_t from, size_t to,
+                        uint32_t fields, CanonExportFormat format) {
+    if (to > store->count) to = store->count;
+    if (from > to) from = to;
+    ex->store = store;
+    ex->next = from;
+    ex->end = to;
+    ex->fields = fields ? fields : CANON_FIELDS_ALL;
+    ex->format = (uint8_t)format;
+}
+
+static size_t string_len(const CanonStore* store, uint32_t ref) {
+    size_t len;
+    canon_store_string(store, ref, &len);
+    return len;
+}
+
+/* The most the next row can take, so a caller can always make room for at least one. */
+size_t canon_export_bound(const CanonExport* ex) {
+    if (canon_export_done(ex)) return 0;
+    if (ex->format == CANON_EXPORT_BIN) return BROADCAST_BIN_HEADER + BROADCAST_BIN_RECORD;
+    
+    const CanonStore* store = ex->store;
+    size_t row = ex->next;
+    size_t bound = EXPORT_ROW_FIXED;
+    /* Escaping can grow a string sixfold (\u00XX). */
+    if (ex->fields & CANON_FIELD_EVENT) bound += 6 * strlen(canon_store_event_name(store, row));
+    if (ex->fields & CANON_FIELD_ARTICLE) bound += 6 * string_len(store, store->article[row]);
+    if (ex->fields & CANON_FIELD_ID) bound += 6 * string_len(store, store->id[row]);
+    if (ex->fields & CANON_FIELD_RECORD) bound += string_len(store, store->record[row]);
+    return bound;
+}
+
+static size_t put_uint(char* out, uint64_t v) {
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    for (size_t i = 0; i < n; i++) out[i] = digits[n - 1 - i];
+    return n;
+}
+
+static size_t put_text(char* out, const char* text) {
+    size_t len = strlen(text);
+    memcpy(out, text, len);
+    return len;
+}
+
+static size_t put_escaped(char* out, const char* str, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)str[i];
+        if (c == '"' || c == '\\') {
+            out[n++] = '\\';
+            out[n++] = (char)c;
+        } else if (c < 0x20) {
+            memcpy(out + n, "\\u00", 4);
+            out[n + 4] = hex[c >> 4];
+            out[n + 5] = hex[c & 15];
+            n += 6;
+        } else {
+            out[n++] = (char)c;
+        }
+    }
+    return n;
+}
+
+static size_t put_string_field(char* out, const char* key, const char* str, size_t len) {
+    size_t n = put_text(out, key);
+    n += put_escaped(out + n, str, len);
+    out[n++] = '"';
+    return n;
+}
+
+/* One NDJSON line; out has canon_export_bound bytes. Integers only, no printf. */
+static size_t encode_line(const CanonExport* ex, size_t row, char* out) {
+    const CanonStore* store = ex->store;
+    uint32_t fields = ex->fields;
+    size_t n = put_text(out, "{\"index\":");
+    n += put_uint(out + n, row);
+    if (fields & CANON_FIELD_MATRIX) {
+        uint8_t matrix[7];
+        canon_store_matrix(store, row, matrix);
+        n += put_text(out + n, ",\"matrix\":[");
+        for (int i = 0; i < 7; i++) {
+            out[n++] = (char)('0' + matrix[i]);
+            out[n++] = i < 6 ? ',' : ']';
+        }
+    }
+    if (fields & CANON_FIELD_ANGLE) {
+        /* Hundredths of a degree, rounded, as %.2f would print them. */
+        uint32_t centi = ((uint32_t)store->angle[row] * 36000u + 32768u) >> 16;
+        n += put_text(out + n, ",\"angle\":");
+        n += put_uint(out + n, centi / 100);
+        out[n++] = '.';
+        out[n++] = (char)('0' + centi % 100 / 10);
+        out[n++] = (char)('0' + centi % 10);
+    }
+    if (fields & CANON_FIELD_SEED) {
+        n += put_text(out + n, ",\"seed\":");
+        n += put_uint(out + n, store->seed[row]);
+    }
+    if (fields & CANON_FIELD_TIMESTAMP) {
+        n += put_text(out + n, ",\"timestamp\":");
+        n += put_uint(out + n, store->timestamp[row]);
+    }
+    if (fields & CANON_FIELD_EVENT) {
+        const char* event = canon_store_event_name(store, row);
+        n += put_string_field(out + n, ",\"event\":\"", event, strlen(event));
+    }
+    if (fields & CANON_FIELD_ARTICLE) {
+        size_t len;
+        const char* article = canon_store_string(store, store->article[row], &len);
+        n += put_string_field(out + n, ",\"article\":\"", article, len);
+    }
+    if (fields & CANON_FIELD_ID) {
+        size_t len;
+        const char* id = canon_store_string(store, store->id[row], &len);
+        n += put_string_field(out + n, ",\"id\":\"", id, len);
+    }
+    if (fields & CANON_FIELD_CHAPTER) {
+        n += put_text(out + n, ",\"chapter\":");
+        n += put_uint(out + n, store->chapter[row]);
+    }
+    if (fields & CANON_FIELD_VERSE) {
+        n += put_text(out + n, ",\"verse\":");
+        n += put_uint(out + n, store->verse[row]);
+    }
+    if (fields & CANON_FIELD_RECORD) {
+        size_t len;
+        const char* record = canon_store_string(store, store->record[row], &len);
+        n += put_text(out + n, ",\"record\":");
+        if (len) {
+            memcpy(out + n, record, len);
+            n += len;
+        } else {
+            n += put_text(out + n, "null");
+        }
+    }
+    out[n++] = '}';
+    out[n++] = '\n';
+    return n;
+}
+
+/*
+ * Encodes as many whole rows as fit in cap, as NDJSON lines or as one
+ * fano-bin message, and advances the cursor past them. Returns the bytes
+ * written, 0 when the next row needs more than cap (see canon_export_bound).
+ */
+size_t canon_export_rows(CanonExport* ex, char* out, size_t cap) {
+    if (ex->format == CANON_EXPORT_BIN) {
+        if (cap < BROADCAST_BIN_HEADER + BROADCAST_BIN_RECORD) return 0;
+        size_t count = (cap - BROADCAST_BIN_HEADER) / BROADCAST_BIN_RECORD;
+        if (count > ex->end - ex->next) count = ex->end - ex->next;
+        if (count > EXPORT_BIN_BATCH) count = EXPORT_BIN_BATCH;
+        unsigned char* bin = (unsigned char*)out;
+        broadcast_bin_header(bin, BROADCAST_CANON, (uint16_t)count);
+        for (size_t i = 0; i < count; i++) {
+            broadcast_bin_canon_record(bin + BROADCAST_BIN_HEADER + i * BROADCAST_BIN_RECORD,
+                                       ex->store, (uint32_t)(ex->next + i));
+        }
+        ex->next += count;
+        return BROADCAST_BIN_HEADER + count * BROADCAST_BIN_RECORD;
+    }
+    
+    size_t n = 0;
+    while (!canon_export_done(ex)) {
+        if (cap - n < canon_export_bound(ex)) break;
+        n += encode_line(ex, ex->next, out + n);
+        ex->next++;
+    }
+    return n;
+}
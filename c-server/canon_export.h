@@ -0,0 +1,51 @@
+#ifndef CANON_EXPORT_H
+#define CANON_EXPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "canon_store.h"
+
+#define CANON_FIELD_MATRIX (1u << 0)
+#define CANON_FIELD_ANGLE (1u << 1)
+#define CANON_FIELD_SEED (1u << 2)
+#define CANON_FIELD_TIMESTAMP (1u << 3)
+#define CANON_FIELD_EVENT (1u << 4)
+#define CANON_FIELD_ARTICLE (1u << 5)
+#define CANON_FIELD_ID (1u << 6)
+#define CANON_FIELD_CHAPTER (1u << 7)
+#define CANON_FIELD_VERSE (1u << 8)
+#define CANON_FIELD_RECORD (1u << 9)
+#define CANON_FIELDS_ALL 0x3FFu
+
+typedef enum {
+    CANON_EXPORT_NDJSON = 0,
+    CANON_EXPORT_BIN = 1
+} CanonExportFormat;
+
+/*
+ * Cursor over rows [next, end) of a store, encoded a batch at a time into
+ * whatever buffer the caller hands over, so a range of any size goes out
+ * in bounded memory. NDJSON lines carry the index and the chosen fields
+ * in the shape /api/chunk/N uses; the binary form is fano-bin canon
+ * messages (see broadcast.h), whose records have fixed fields. The store
+ * must stay alive until the cursor is done.
+ */
+typedef struct {
+    const CanonStore* store;
+    size_t next;
+    size_t end;
+    uint32_t fields;
+    uint8_t format;
+} CanonExport;
+
+uint32_t canon_export_fields(const char* list, size_t len);
+void canon_export_begin(CanonExport* ex, const CanonStore* store, size_t from, size_t to,
+                        uint32_t fields, CanonExportFormat format);
+size_t canon_export_bound(const CanonExport* ex);
+size_t canon_export_rows(CanonExport* ex, char* out, size_t cap);
+
+static inline int canon_export_done(const CanonExport* ex) {
+    return ex->next >= ex->end;
+}
+
+#endif
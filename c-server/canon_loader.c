@@ -0,0 +1,532 @@
+#include "canon_loader.h"
+#include "ndjson.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* The files one thread read, in the order it opened them. */
+typedef struct {
+    CanonSource* items;
+    size_t count;
+    size_t cap;
+    uint8_t overflow;
+} CanonSourceList;
+
+/* One manifest series file, parsed on the pool into its own store. */
+typedef struct {
+    char path[1024];
+    uint64_t base_timestamp;
+    CanonStore store;
+    CanonFileStats stats;
+    CanonSourceList sources;
+    int rc;
+} CanonSeriesJob;
+
+typedef struct {
+    CanonSeriesJob* jobs;
+    size_t count;
+    _Atomic size_t next;
+} CanonJobQueue;
+
+typedef struct {
+    uint64_t timestamp;
+    uint32_t part;
+    uint32_t row;
+} CanonMergeEntry;
+
+typedef struct {
+    CanonStore* store;
+    CanonFileStats* stats;
+    CanonSourceList* sources;
+    CanonJobQueue* queue;
+    char dir[512];
+    int depth;
+    uint64_t last_timestamp;
+    char* scratch;
+    size_t scratch_cap;
+    size_t scratch_used;
+    CanonRecord record;
+    const char* series_path;
+    size_t series_path_len;
+    uint8_t is_series;
+    uint8_t has_timestamp;
+    uint8_t has_t;
+} CanonLoadContext;
+
+static int load_file(CanonLoadContext* parent, const char* path);
+
+static void dir_of(const char* path, char* dir, size_t cap) {
+    const char* slash = strrchr(path, '/');
+    size_t n = slash ? (size_t)(slash - path) : 0;
+    if (n >= cap) n = cap - 1;
+    if (n) memcpy(dir, path, n);
+    else if (slash) dir[n++] = '/';
+    dir[n] = '\0';
+}
+
+/* Too many files or too long a path and the list is dropped: the canon is then never cached. */
+static void source_add(CanonSourceList* list, const char* path, uint64_t fingerprint) {
+    if (list->overflow) return;
+    if (list->count == CANON_MAX_SOURCES || strlen(path) >= CANON_SOURCE_PATH_MAX) {
+        list->overflow = 1;
+        return;
+    }
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 4;
+        CanonSource* grown = realloc(list->items, cap * sizeof(CanonSource));
+        if (!grown) {
+            list->overflow = 1;
+            return;
+        }
+        list->items = grown;
+        list->cap = cap;
+    }
+    CanonSource* source = &list->items[list->count++];
+    memset(source, 0, sizeof(*source));
+    source->fingerprint = fingerprint;
+    memcpy(source->path, path, strlen(path));
+}
+
+/* Appends list to the stats' sources, or empties them when the whole set no longer fits. */
+static void sources_collect(CanonLoadStats* stats, CanonSourceList* list, int* overflow) {
+    if (list->overflow || stats->source_count + list->count > CANON_MAX_SOURCES) *overflow = 1;
+    if (!*overflow && list->count) {
+        memcpy(stats->sources + stats->source_count, list->items, list->count * sizeof(CanonSource));
+        stats->source_count += list->count;
+    }
+    free(list->items);
+    memset(list, 0, sizeof(*list));
+}
+
+static double elapsed_ms_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* Strings without escapes are used in place; the rest decode into scratch. */
+static const char* field_string(CanonLoadContext* ctx, const NdjsonField* field, size_t* len) {
+    if (field->type != NDJSON_STRING || !field->has_escapes) {
+        *len = field->raw_len;
+        return field->raw;
+    }
+    char* out = ctx->scratch + ctx->scratch_used;
+    *len = ndjson_decode_string(field->raw, field->raw_len, out);
+    ctx->scratch_used += *len;
+    return out;
+}
+
+static void parse_matrix(const NdjsonField* field, uint8_t matrix[7]) {
+    const char* p = field->raw + 1;
+    const char* end = field->raw + field->raw_len;
+    for (int i = 0; i < 7 && p < end; i++) {
+        char* next;
+        long value = strtol(p, &next, 10);
+        if (next == p) break;
+        matrix[i] = (uint8_t)(value & 3);
+        p = next;
+        while (p < end && (*p == ',' || *p == ' ')) p++;
+    }
+}
+
+static int on_field(const NdjsonField* field, void* arg) {
+    CanonLoadContext* ctx = arg;
+    CanonRecord* rec = &ctx->record;
+    
+    if (ndjson_key_is(field, "event")) {
+        rec->event = field_string(ctx, field, &rec->event_len);
+        ctx->is_series = rec->event_len == 6 && memcmp(rec->event, "series", 6) == 0;
+    } else if (ndjson_key_is(field, "matrix") && field->type == NDJSON_ARRAY) {
+        parse_matrix(field, rec->matrix);
+    } else if (ndjson_key_is(field, "angle") && field->type == NDJSON_NUMBER) {
+        rec->angle = strtof(field->raw, NULL);
+    } else if (ndjson_key_is(field, "t") && field->type == NDJSON_NUMBER) {
+        rec->timestamp = strtoull(field->raw, NULL, 10);
+        ctx->has_t = 1;
+    } else if (ndjson_key_is(field, "timestamp") && field->type == NDJSON_NUMBER) {
+        if (!ctx->has_t) rec->timestamp = strtoull(field->raw, NULL, 10);
+        ctx->has_timestamp = 1;
+    } else if (ndjson_key_is(field, "article")) {
+        rec->article = field_string(ctx, field, &rec->article_len);
+    } else if (ndjson_key_is(field, "id")) {
+        rec->id = field_string(ctx, field, &rec->id_len);
+    } else if (ndjson_key_is(field, "chapter") && field->type == NDJSON_NUMBER) {
+        rec->chapter = (uint16_t)strtoul(field->raw, NULL, 10);
+    } else if (ndjson_key_is(field, "verse") && field->type == NDJSON_NUMBER) {
+        rec->verse = (uint16_t)strtoul(field->raw, NULL, 10);
+    } else if (ndjson_key_is(field, "text")) {
+        rec->text = field_string(ctx, field, &rec->text_len);
+    } else if ((ndjson_key_is(field, "quote") || ndjson_key_is(field, "title")) && !rec->text) {
+        rec->text = field_string(ctx, field, &rec->text_len);
+    } else if (ndjson_key_is(field, "path")) {
+        ctx->series_path = field_string(ctx, field, &ctx->series_path_len);
+    }
+    return 0;
+}
+
+static int on_line(const char* line, size_t len, void* arg) {
+    CanonLoadContext* ctx = arg;
+    
+    if (ctx->scratch_cap < len) {
+        char* grown = realloc(ctx->scratch, len);
+        if (!grown) return -1;
+        ctx->scratch = grown;
+        ctx->scratch_cap = len;
+    }
+    ctx->scratch_used = 0;
+    memset(&ctx->record, 0, sizeof(ctx->record));
+    ctx->series_path = NULL;
+    ctx->is_series = ctx->has_t = ctx->has_timestamp = 0;
+    
+    if (ndjson_parse_object(line, len, on_field, ctx) < 0) {
+        fprintf(stderr, "Canon: skipping malformed record (%.40s...)\n", line);
+        return 0;
+    }
+    
+    /* Manifest series entries are replaced by the records they point at. */
+    if (ctx->is_series && ctx->series_path && ctx->depth < CANON_MAX_DEPTH) {
+        char path[1024];
+        if (ctx->series_path[0] == '/' || !ctx->dir[0]) {
+            snprintf(path, sizeof(path), "%.*s", (int)ctx->series_path_len, ctx->series_path);
+        } else {
+            snprintf(path, sizeof(path), "%s/%.*s", ctx->dir, (int)ctx->series_path_len, ctx->series_path);
+        }
+        /* Top-level series are deferred to the pool; nested ones load inline. */
+        CanonJobQueue* queue = ctx->queue;
+        if (queue && queue->count < CANON_MAX_SERIES && access(path, R_OK) == 0) {
+            CanonSeriesJob* job = &queue->jobs[queue->count++];
+            snprintf(job->path, sizeof(job->path), "%s", path);
+            job->base_timestamp = (ctx->has_t || ctx->has_timestamp) ? ctx->record.timestamp
+                                                                    : ctx->last_timestamp;
+            ctx->last_timestamp = job->base_timestamp;
+            return 0;
+        }
+        if (load_file(ctx, path) == 0) return 0;
+    }
+    
+    CanonRecord* rec = &ctx->record;
+    if (!ctx->has_t && !ctx->has_timestamp) {
+        rec->timestamp = ctx->last_timestamp + CANON_DEFAULT_SPACING_MS;
+    }
+    ctx->last_timestamp = rec->timestamp;
+    rec->record = line;
+    rec->record_len = len;
+    
+    if (canon_store_append(ctx->store, rec) < 0) return -1;
+    ctx->stats->records++;
+    return 0;
+}
+
+static int load_file(CanonLoadContext* parent, const char* path) {
+    CanonLoadContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.store = parent->store;
+    ctx.stats = parent->stats;
+    ctx.sources = parent->sources;
+    ctx.depth = parent->depth + 1;
+    ctx.queue = ctx.depth == 0 ? parent->queue : NULL;
+    ctx.last_timestamp = parent->last_timestamp;
+    dir_of(path, ctx.dir, sizeof(ctx.dir));
+    
+    /* Noted before reading, so an edit made while it is read shows as a change later. */
+    uint64_t fingerprint = canon_file_fingerprint(path);
+    if (fingerprint) source_add(ctx.sources, path, fingerprint);
+    
+    /* Every record is kept verbatim plus its decoded text. */
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        canon_store_reserve_strings(ctx.store, ctx.store->strings_len + (size_t)st.st_size * 2);
+    }
+    
+    size_t bytes = 0;
+    int lines = ndjson_read_file(path, on_line, &ctx, &bytes);
+    free(ctx.scratch);
+    if (lines < 0) {
+        fprintf(stderr, "Canon: failed to read %s\n", path);
+        return -1;
+    }
+    
+    parent->last_timestamp = ctx.last_timestamp;
+    parent->stats->files++;
+    parent->stats->bytes += bytes;
+    return 0;
+}
+
+static void run_series_job(CanonSeriesJob* job) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    CanonLoadContext parent;
+    memset(&parent, 0, sizeof(parent));
+    parent.store = &job->store;
+    parent.stats = &job->stats;
+    parent.sources = &job->sources;
+    parent.last_timestamp = job->base_timestamp;
+    
+    job->rc = load_file(&parent, job->path);
+    job->stats.parse_ms = elapsed_ms_since(&start);
+}
+
+static void* series_worker(void* arg) {
+    CanonJobQueue* queue = arg;
+    for (;;) {
+        size_t i = atomic_fetch_add(&queue->next, 1);
+        if (i >= queue->count) break;
+        run_series_job(&queue->jobs[i]);
+    }
+    return NULL;
+}
+
+static int compare_merge_entry(const void* a, const void* b) {
+    const CanonMergeEntry* x = a;
+    const CanonMergeEntry* y = b;
+    if (x->timestamp != y->timestamp) return x->timestamp < y->timestamp ? -1 : 1;
+    return x->row < y->row ? -1 : (x->row > y->row);
+}
+
+/*
+ * Interleaves every part into store by timestamp. Ties keep manifest order
+ * (the manifest's own records first, then series in the order listed) and
+ * file order within a part, so the result is deterministic. Series files are
+ * normally already in time order, so each part only needs sorting when it
+ * is not, and the parts are then merged k-way. The largest part's string
+ * heap is adopted rather than copied.
+ */
+static int merge_parts(CanonStore* store, CanonStore** parts, size_t part_count) {
+    size_t total = 0, strings = 0, largest = 0;
+    for (size_t p = 0; p < part_count; p++) {
+        total += parts[p]->count;
+        strings += parts[p]->strings_len;
+        if (parts[p]->strings_len > parts[largest]->strings_len) largest = p;
+    }
+    if (total == 0) return 0;
+    
+    CanonMergeEntry* order = malloc(total * sizeof(CanonMergeEntry));
+    size_t* cursor = calloc(part_count * 2, sizeof(size_t));
+    CanonStoreRemap* remaps = calloc(part_count, sizeof(CanonStoreRemap));
+    if (!order || !cursor || !remaps) {
+        free(order);
+        free(cursor);
+        free(remaps);
+        return -1;
+    }
+    size_t* end = cursor + part_count;
+    
+    size_t n = 0;
+    for (size_t p = 0; p < part_count; p++) {
+        const CanonStore* part = parts[p];
+        int sorted = 1;
+        cursor[p] = n;
+        for (size_t row = 0; row < part->count; row++) {
+            order[n].timestamp = part->timestamp[row];
+            order[n].part = (uint32_t)p;
+            order[n].row = (uint32_t)row;
+            if (row && part->timestamp[row] < part->timestamp[row - 1]) sorted = 0;
+            n++;
+        }
+        end[p] = n;
+        if (!sorted) {
+            qsort(order + cursor[p], part->count, sizeof(CanonMergeEntry), compare_merge_entry);
+        }
+    }
+    
+    int rc = canon_store_adopt_strings(store, parts[largest], &remaps[largest]);
+    if (rc == 0 && (canon_store_reserve(store, total) < 0 ||
+                    canon_store_reserve_strings(store, strings + 64 * 1024) < 0)) {
+        rc = -1;
+    }
+    for (size_t p = 0; p < part_count && rc == 0; p++) {
+        if (p != largest) rc = canon_store_import_strings(store, parts[p], &remaps[p]);
+    }
+    
+    /* Few parts, so the next row is found by scanning every cursor. */
+    for (size_t i = 0; i < total && rc == 0; i++) {
+        size_t best = part_count;
+        for (size_t p = 0; p < part_count; p++) {
+            if (cursor[p] == end[p]) continue;
+            if (best == part_count || order[cursor[p]].timestamp < order[cursor[best]].timestamp) {
+                best = p;
+            }
+        }
+        const CanonMergeEntry* next = &order[cursor[best]++];
+        rc = canon_store_append_row(store, parts[best], next->row, &remaps[best]);
+    }
+    free(remaps);
+    free(cursor);
+    free(order);
+    return rc;
+}
+
+static int online_cpus(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+/*
+ * Streams an NDJSON canon into store. "series" records in the top-level file
+ * name further NDJSON files (relative to its directory); each is parsed on a
+ * thread pool into its own store, then everything is merged by timestamp.
+ * Series nested deeper are expanded inline by the thread that finds them.
+ */
+int canon_load(CanonStore* store, const char* path, CanonLoadStats* stats) {
+    CanonLoadStats local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    
+    CanonJobQueue queue;
+    memset(&queue, 0, sizeof(queue));
+    queue.jobs = calloc(CANON_MAX_SERIES, sizeof(CanonSeriesJob));
+    if (!queue.jobs) return -1;
+    
+    CanonFileStats manifest_stats;
+    memset(&manifest_stats, 0, sizeof(manifest_stats));
+    CanonSourceList manifest_sources;
+    memset(&manifest_sources, 0, sizeof(manifest_sources));
+    CanonLoadContext root;
+    memset(&root, 0, sizeof(root));
+    root.store = store;
+    root.stats = &manifest_stats;
+    root.sources = &manifest_sources;
+    root.queue = &queue;
+    root.depth = -1;
+    
+    int rc = load_file(&root, path);
+    int overflow = 0;
+    sources_collect(stats, &manifest_sources, &overflow);
+    
+    if (rc == 0 && queue.count > 0) {
+        for (size_t i = 0; i < queue.count; i++) canon_store_init(&queue.jobs[i].store);
+        
+        int threads = online_cpus();
+        if (threads > CANON_MAX_THREADS) threads = CANON_MAX_THREADS;
+        if ((size_t)threads > queue.count) threads = (int)queue.count;
+        
+        pthread_t pool[CANON_MAX_THREADS];
+        int started = 0;
+        for (int i = 1; i < threads; i++) {
+            if (pthread_create(&pool[started], NULL, series_worker, &queue) != 0) break;
+            started++;
+        }
+        series_worker(&queue);
+        for (int i = 0; i < started; i++) pthread_join(pool[i], NULL);
+        stats->threads = started + 1;
+        
+        struct timespec merge_start;
+        clock_gettime(CLOCK_MONOTONIC, &merge_start);
+        
+        /* The manifest's own records become part 0 of the merge. */
+        CanonStore manifest = *store;
+        canon_store_init(store);
+        CanonStore* parts[CANON_MAX_SERIES + 1];
+        parts[0] = &manifest;
+        for (size_t i = 0; i < queue.count; i++) {
+            CanonSeriesJob* job = &queue.jobs[i];
+            parts[i + 1] = &job->store;
+            if (job->rc < 0) fprintf(stderr, "Canon: series %s failed to load\n", job->path);
+        }
+        rc = merge_parts(store, parts, queue.count + 1);
+        stats->merge_ms = elapsed_ms_since(&merge_start);
+        
+        canon_store_free(&manifest);
+        for (size_t i = 0; i < queue.count; i++) {
+            CanonSeriesJob* job = &queue.jobs[i];
+            CanonFileStats* file = &stats->series[stats->series_count++];
+            *file = job->stats;
+            snprintf(file->path, sizeof(file->path), "%.255s", job->path);
+            stats->files += job->stats.files;
+            stats->bytes += job->stats.bytes;
+            stats->records += job->stats.records;
+            sources_collect(stats, &job->sources, &overflow);
+            canon_store_free(&job->store);
+        }
+    }
+    free(queue.jobs);
+    if (overflow) stats->source_count = 0;
+    
+    stats->files += manifest_stats.files;
+    stats->bytes += manifest_stats.bytes;
+    stats->records += manifest_stats.records;
+    stats->elapsed_ms = elapsed_ms_since(&start);
+    return rc;
+}
+
+typedef struct {
+    char dir[512];
+    const CanonSource* sources;
+    size_t count;
+    canon_source_fn on_source;
+    void* source_ctx;
+    const char* path;
+    size_t path_len;
+    uint8_t is_series;
+    uint8_t changed;
+} CanonSourceCheck;
+
+static int check_field(const NdjsonField* field, void* arg) {
+    CanonSourceCheck* check = arg;
+    if (ndjson_key_is(field, "event")) {
+        check->is_series = field->raw_len == 6 && memcmp(field->raw, "series", 6) == 0;
+    } else if (ndjson_key_is(field, "path") && field->type == NDJSON_STRING) {
+        check->path = field->raw;
+        check->path_len = field->raw_len;
+    }
+    return 0;
+}
+
+/* A series the manifest names must have been read, or still be unreadable as it was then. */
+static int check_line(const char* line, size_t len, void* arg) {
+    CanonSourceCheck* check = arg;
+    check->path = NULL;
+    check->is_series = 0;
+    if (ndjson_parse_object(line, len, check_field, check) < 0) return 0;
+    if (!check->is_series || !check->path) return 0;
+    
+    char path[1024];
+    if (check->path[0] == '/' || !check->dir[0]) {
+        snprintf(path, sizeof(path), "%.*s", (int)check->path_len, check->path);
+    } else {
+        snprintf(path, sizeof(path), "%s/%.*s", check->dir, (int)check->path_len, check->path);
+    }
+    if (check->on_source) check->on_source(path, check->source_ctx);
+    for (size_t i = 0; i < check->count; i++) {
+        if (strcmp(check->sources[i].path, path) == 0) return 0;
+    }
+    if (access(path, R_OK) == 0) check->changed = 1;
+    return 0;
+}
+
+/*
+ * Whether loading manifest now would read the same files as the load that
+ * recorded sources, unchanged: each listed file still has the fingerprint
+ * it was read with, and every series the manifest names is listed or still
+ * unreadable. Only the manifest is parsed; the series files are stat'ed,
+ * and series nested inside them are covered by their parent's fingerprint.
+ * on_source, when given, sees every listed file and every series named.
+ */
+int canon_sources_current(const char* manifest, const CanonSource* sources, size_t count,
+                          canon_source_fn on_source, void* ctx) {
+    CanonSourceCheck check;
+    memset(&check, 0, sizeof(check));
+    check.sources = sources;
+    check.count = count;
+    check.on_source = on_source;
+    check.source_ctx = ctx;
+    check.changed = count == 0 || strcmp(sources[0].path, manifest) != 0;
+    
+    if (on_source) on_source(manifest, ctx);
+    for (size_t i = 0; i < count; i++) {
+        if (on_source && strcmp(sources[i].path, manifest) != 0) on_source(sources[i].path, ctx);
+        if (canon_file_fingerprint(sources[i].path) != sources[i].fingerprint) check.changed = 1;
+    }
+    dir_of(manifest, check.dir, sizeof(check.dir));
+    if (ndjson_read_file(manifest, check_line, &check, NULL) < 0) check.changed = 1;
+    return !check.changed;
+}
@@ -0,0 +1,41 @@
+#ifndef CANON_LOADER_H
+#define CANON_LOADER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "canon_store.h"
+
+#define CANON_MAX_DEPTH 4
+#define CANON_DEFAULT_SPACING_MS 100
+#define CANON_MAX_SERIES 32
+#define CANON_MAX_THREADS 16
+
+/* Called with each source file canon_sources_current looks at, the manifest first. */
+typedef void (*canon_source_fn)(const char* path, void* ctx);
+
+typedef struct {
+    char path[256];
+    size_t files;
+    size_t bytes;
+    size_t records;
+    double parse_ms;
+} CanonFileStats;
+
+typedef struct {
+    size_t files;
+    size_t bytes;
+    size_t records;
+    double elapsed_ms;
+    double merge_ms;
+    int threads;
+    size_t series_count;
+    CanonFileStats series[CANON_MAX_SERIES];
+    size_t source_count;                       /* 0 when more were read than fit */
+    CanonSource sources[CANON_MAX_SOURCES];    /* every file read, the manifest first */
+} CanonLoadStats;
+
+int canon_load(CanonStore* store, const char* path, CanonLoadStats* stats);
+int canon_sources_current(const char* manifest, const CanonSource* sources, size_t count,
+                          canon_source_fn on_source, void* ctx);
+
+#endif
@@ -0,0 +1,233 @@
+#include "canon_snapshot.h"
+#include "canon_loader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#define CANON_WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE)
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void watch_directory_of(CanonPublisher* pub, const char* file) {
+    if (pub->inotify_fd < 0 || pub->watch_count >= CANON_MAX_WATCHES) return;
+    char dir[256];
+    const char* slash = strrchr(file, '/');
+    if (slash) {
+        size_t n = (size_t)(slash - file);
+        if (n >= sizeof(dir)) n = sizeof(dir) - 1;
+        memcpy(dir, file, n);
+        dir[n] = '\0';
+    } else {
+        strcpy(dir, ".");
+    }
+    int wd = inotify_add_watch(pub->inotify_fd, dir, CANON_WATCH_EVENTS);
+    if (wd < 0) return;
+    for (int i = 0; i < pub->watch_count; i++) {
+        if (pub->watches[i] == wd) return;
+    }
+    pub->watches[pub->watch_count++] = wd;
+}
+
+static void watch_source(const char* path, void* ctx) {
+    watch_directory_of((CanonPublisher*)ctx, path);
+}
+
+/*
+ * Maps the binary canon when the sources it lists are unchanged (see
+ * canon_sources_current), otherwise parses them and rewrites it. When the sources cannot be read (an editor replacing the manifest,
+ * say) the first build falls back to an empty canon, but a rebuild returns
+ * NULL so the content and every session's place in it stay as they were
+ * until the next change.
+ */
+static CanonSnapshot* snapshot_build(CanonPublisher* pub) {
+    CanonSnapshot* snap = calloc(1, sizeof(CanonSnapshot));
+    if (!snap) return NULL;
+    atomic_init(&snap->refs, 1);
+    CanonStore* store = &snap->store;
+    canon_store_init(store);
+    
+    int listed = canon_store_sources(pub->bin_path, snap->sources, CANON_MAX_SOURCES);
+    if (listed > 0 && canon_sources_current(pub->manifest, snap->sources, listed, watch_source, pub) &&
+        canon_store_map(store, pub->bin_path, canon_sources_hash(snap->sources, listed)) == 0) {
+        printf("Mapped %zu canon chunks from %s\n", store->count, pub->bin_path);
+        snap->source_count = (size_t)listed;
+        snap->generation = ++pub->generation;
+        return snap;
+    }
+    
+    CanonLoadStats stats;
+    if (canon_load(store, pub->manifest, &stats) < 0) {
+        canon_store_free(store);
+        if (atomic_load(&pub->current)) {
+            fprintf(stderr, "Failed to open %s, keeping the current canon\n", pub->manifest);
+            free(snap);
+            return NULL;
+        }
+        fprintf(stderr, "Failed to open %s, using empty canon\n", pub->manifest);
+        snap->generation = ++pub->generation;
+        return snap;
+    }
+    snap->generation = ++pub->generation;
+    snap->source_count = stats.source_count;
+    memcpy(snap->sources, stats.sources, stats.source_count * sizeof(CanonSource));
+    for (size_t i = 0; i < stats.source_count; i++) watch_directory_of(pub, stats.sources[i].path);
+    for (size_t i = 0; i < stats.series_count; i++) {
+        const CanonFileStats* series = &stats.series[i];
+        printf("  %-40s %6zu chunks %10zu bytes %8.2f ms\n",
+               series->path, series->records, series->bytes, series->parse_ms);
+    }
+    printf("Loaded %zu canon chunks from %zu files (%zu bytes) in %.2f ms (%d threads, merge %.2f ms)\n",
+           store->count, stats.files, stats.bytes, stats.elapsed_ms, stats.threads, stats.merge_ms);
+    
+    if (stats.source_count == 0) {
+        fprintf(stderr, "Canon: more sources than canon.bin can list, not caching\n");
+    } else if (canon_store_save(store, pub->bin_path, stats.sources, stats.source_count) == 0) {
+        printf("Wrote binary canon to %s\n", pub->bin_path);
+    }
+    return snap;
+}
+
+static void publish(CanonPublisher* pub, CanonSnapshot* snap) {
+    CanonSnapshot* old = atomic_exchange(&pub->current, snap);
+    /* A reader that saw old may still be about to take its reference; any that start now see snap. */
+    unsigned side = atomic_fetch_add(&pub->epoch, 1) & 1;
+    while (atomic_load(&pub->acquiring[side]) != 0) {
+        sched_yield();
+    }
+    if (old) canon_snapshot_release(old);
+}
+
+CanonSnapshot* canon_snapshot_acquire(CanonPublisher* pub) {
+    unsigned side;
+    for (;;) {
+        unsigned epoch = atomic_load(&pub->epoch);
+        side = epoch & 1;
+        atomic_fetch_add(&pub->acquiring[side], 1);
+        /* A swap between the two loads may already have checked this side. */
+        if (atomic_load(&pub->epoch) == epoch) break;
+        atomic_fetch_sub(&pub->acquiring[side], 1);
+    }
+    CanonSnapshot* snap = atomic_load(&pub->current);
+    if (snap) atomic_fetch_add(&snap->refs, 1);
+    atomic_fetch_sub(&pub->acquiring[side], 1);
+    return snap;
+}
+
+void canon_snapshot_release(CanonSnapshot* snap) {
+    if (!snap) return;
+    if (atomic_fetch_sub(&snap->refs, 1) == 1) {
+        canon_store_free(&snap->store);
+        free(snap);
+    }
+}
+
+/* First chunk at or after timestamp; the merged canon is in time order. */
+size_t canon_snapshot_find(const CanonSnapshot* snap, uint64_t timestamp) {
+    const CanonStore* store = &snap->store;
+    size_t lo = 0, hi = store->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (store->timestamp[mid] < timestamp) lo = mid + 1;
+        else hi = mid;
+    }
+    if (store->count && lo >= store->count) lo = store->count - 1;
+    return lo;
+}
+
+/*
+ * Rebuilds and publishes when the sources no longer match the current
+ * snapshot. That check parses only the manifest and stats the rest, so an
+ * unrelated change in a watched directory costs next to nothing. Every
+ * source's directory is watched along the way, whether the snapshot is
+ * then mapped or parsed, and series added since are picked up the same way.
+ */
+int canon_publisher_reload(CanonPublisher* pub) {
+    CanonSnapshot* current = atomic_load(&pub->current);
+    if (current && canon_sources_current(pub->manifest, current->sources, current->source_count,
+                                         watch_source, pub)) {
+        return 0;
+    }
+    
+    CanonSnapshot* snap = snapshot_build(pub);
+    if (!snap) return -1;
+    publish(pub, snap);
+    if (current) {
+        printf("Canon reloaded: generation %lu, %zu chunks\n",
+               (unsigned long)snap->generation, snap->store.count);
+    }
+    return 1;
+}
+
+static void* canon_watch_thread(void* arg) {
+    CanonPublisher* pub = (CanonPublisher*)arg;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    uint64_t reload_at = 0;
+    
+    while (pub->running) {
+        /* Editors write in bursts; rebuild once things have settled. */
+        int timeout = 1000;
+        if (reload_at) {
+            uint64_t now = monotonic_ms();
+            if (now >= reload_at) {
+                reload_at = 0;
+                canon_publisher_reload(pub);
+                continue;
+            }
+            timeout = (int)(reload_at - now);
+        }
+        
+        struct pollfd pfd = { .fd = pub->inotify_fd, .events = POLLIN };
+        int ready = poll(&pfd, 1, timeout);
+        if (ready <= 0) continue;
+        
+        ssize_t len = read(pub->inotify_fd, buf, sizeof(buf));
+        if (len <= 0) {
+            if (len < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+            break;
+        }
+        reload_at = monotonic_ms() + CANON_RELOAD_DEBOUNCE_MS;
+    }
+    return NULL;
+}
+
+int canon_publisher_init(CanonPublisher* pub, const char* manifest, const char* bin_path) {
+    memset(pub, 0, sizeof(*pub));
+    snprintf(pub->manifest, sizeof(pub->manifest), "%s", manifest);
+    snprintf(pub->bin_path, sizeof(pub->bin_path), "%s", bin_path);
+    
+    pub->inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (pub->inotify_fd < 0) {
+        fprintf(stderr, "Canon: inotify unavailable, edits need a restart\n");
+    }
+    watch_directory_of(pub, pub->manifest);
+    
+    if (canon_publisher_reload(pub) < 0) return -1;
+    
+    if (pub->inotify_fd >= 0) {
+        pub->running = 1;
+        if (pthread_create(&pub->watch_thread, NULL, canon_watch_thread, pub) != 0) {
+            pub->running = 0;
+        }
+    }
+    return 0;
+}
+
+void canon_publisher_shutdown(CanonPublisher* pub) {
+    if (pub->running) {
+        pub->running = 0;
+        pthread_join(pub->watch_thread, NULL);
+    }
+    if (pub->inotify_fd >= 0) close(pub->inotify_fd);
+    pub->inotify_fd = -1;
+    canon_snapshot_release(atomic_exchange(&pub->current, NULL));
+}
@@ -0,0 +1,56 @@
+#ifndef CANON_SNAPSHOT_H
+#define CANON_SNAPSHOT_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "canon_store.h"
+
+#define CANON_RELOAD_DEBOUNCE_MS 200
+#define CANON_MAX_WATCHES 16
+
+/*
+ * Immutable canon published to readers. It stays valid while a reference
+ * is held; a reload never touches it, it publishes a new one instead.
+ * sources are the files it was built from (none for the empty fallback).
+ */
+typedef struct {
+    atomic_int refs;
+    uint64_t generation;
+    CanonStore store;
+    size_t source_count;
+    CanonSource sources[CANON_MAX_SOURCES];
+} CanonSnapshot;
+
+/*
+ * Owns the current snapshot and the thread that rebuilds it when the
+ * manifest or any series file changes. Readers acquire without locking:
+ * they announce themselves in acquiring[epoch & 1] for the few
+ * instructions it takes to take a reference. A swap bumps epoch, so later
+ * readers count on the other side, and waits only for the side it left to
+ * drain (a grace period) before dropping its reference to the old
+ * snapshot; steady reader traffic cannot hold it up.
+ */
+typedef struct {
+    _Atomic(CanonSnapshot*) current;
+    atomic_uint acquiring[2];
+    atomic_uint epoch;
+    uint64_t generation;
+    char manifest[256];
+    char bin_path[256];
+    int inotify_fd;
+    int watches[CANON_MAX_WATCHES];
+    int watch_count;
+    volatile uint8_t running;
+    pthread_t watch_thread;
+} CanonPublisher;
+
+int canon_publisher_init(CanonPublisher* pub, const char* manifest, const char* bin_path);
+void canon_publisher_shutdown(CanonPublisher* pub);
+int canon_publisher_reload(CanonPublisher* pub);
+CanonSnapshot* canon_snapshot_acquire(CanonPublisher* pub);
+void canon_snapshot_release(CanonSnapshot* snap);
+size_t canon_snapshot_find(const CanonSnapshot* snap, uint64_t timestamp);
+
+#endif
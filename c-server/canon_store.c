@@ -0,0 +1,529 @@
+#include "canon_store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CANON_BIN_ALIGN 64
+#define CANON_INTERN_MIN 1024
+
+void canon_store_init(CanonStore* store) {
+    memset(store, 0, sizeof(*store));
+}
+
+void canon_store_free(CanonStore* store) {
+    if (store->map) {
+        munmap(store->map, store->map_len);
+    } else {
+        free(store->matrix);
+        free(store->angle);
+        free(store->seed);
+        free(store->timestamp);
+        free(store->event);
+        free(store->chapter);
+        free(store->verse);
+        free(store->article);
+        free(store->id);
+        free(store->text);
+        free(store->record);
+        free(store->strings);
+    }
+    free(store->intern);
+    canon_store_init(store);
+}
+
+static int grow_column(void** column, size_t elem_size, size_t capacity) {
+    void* grown = realloc(*column, capacity * elem_size);
+    if (!grown) return -1;
+    *column = grown;
+    return 0;
+}
+
+static int store_grow(CanonStore* store, size_t capacity) {
+    if (grow_column((void**)&store->matrix, sizeof(uint16_t), capacity) < 0 ||
+        grow_column((void**)&store->angle, sizeof(uint16_t), capacity) < 0 ||
+        grow_column((void**)&store->seed, sizeof(uint32_t), capacity) < 0 ||
+        grow_column((void**)&store->timestamp, sizeof(uint64_t), capacity) < 0 ||
+        grow_column((void**)&store->event, sizeof(uint8_t), capacity) < 0 ||
+        grow_column((void**)&store->chapter, sizeof(uint16_t), capacity) < 0 ||
+        grow_column((void**)&store->verse, sizeof(uint16_t), capacity) < 0 ||
+        grow_column((void**)&store->article, sizeof(uint32_t), capacity) < 0 ||
+        grow_column((void**)&store->id, sizeof(uint32_t), capacity) < 0 ||
+        grow_column((void**)&store->text, sizeof(uint32_t), capacity) < 0 ||
+        grow_column((void**)&store->record, sizeof(uint32_t), capacity) < 0) {
+        return -1;
+    }
+    store->capacity = capacity;
+    return 0;
+}
+
+static uint32_t hash_bytes(const char* str, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int string_equals(const CanonStore* store, uint32_t ref, const char* str, size_t len) {
+    size_t n;
+    const char* s = canon_store_string(store, ref, &n);
+    return n == len && memcmp(s, str, len) == 0;
+}
+
+static int intern_insert(CanonStore* store, uint32_t ref) {
+    size_t n;
+    const char* s = canon_store_string(store, ref, &n);
+    size_t mask = store->intern_cap - 1;
+    size_t slot = hash_bytes(s, n) & mask;
+    while (store->intern[slot]) slot = (slot + 1) & mask;
+    store->intern[slot] = ref;
+    store->intern_used++;
+    return 0;
+}
+
+static int intern_grow(CanonStore* store) {
+    uint32_t* old = store->intern;
+    size_t old_cap = store->intern_cap;
+    size_t cap = old_cap ? old_cap * 2 : CANON_INTERN_MIN;
+    store->intern = calloc(cap, sizeof(uint32_t));
+    if (!store->intern) {
+        store->intern = old;
+        return -1;
+    }
+    store->intern_cap = cap;
+    store->intern_used = 0;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i]) intern_insert(store, old[i]);
+    }
+    free(old);
+    return 0;
+}
+
+int canon_store_reserve(CanonStore* store, size_t count) {
+    if (store->map) return -1;
+    if (store->capacity >= count) return 0;
+    return store_grow(store, count);
+}
+
+/* Sizing the heap up front avoids repeated realloc copies of a large canon. */
+int canon_store_reserve_strings(CanonStore* store, size_t bytes) {
+    if (store->map || store->strings_cap >= bytes) return 0;
+    char* grown = realloc(store->strings, bytes);
+    if (!grown) return -1;
+    store->strings = grown;
+    store->strings_cap = bytes;
+    return 0;
+}
+
+static uint32_t heap_append(CanonStore* store, const char* str, size_t len) {
+    size_t need = sizeof(uint32_t) + len + 1;
+    if (store->strings_len + need > UINT32_MAX) return CANON_NO_STRING;
+    if (store->strings_len + need > store->strings_cap) {
+        size_t cap = store->strings_cap ? store->strings_cap : 64 * 1024;
+        while (cap < store->strings_len + need) cap *= 2;
+        char* grown = realloc(store->strings, cap);
+        if (!grown) return CANON_NO_STRING;
+        store->strings = grown;
+        store->strings_cap = cap;
+    }
+    
+    uint32_t ref = (uint32_t)store->strings_len;
+    uint32_t n = (uint32_t)len;
+    memcpy(store->strings + ref, &n, sizeof(n));
+    if (len) memcpy(store->strings + ref + sizeof(n), str, len);
+    store->strings[ref + sizeof(n) + len] = '\0';
+    store->strings_len += need;
+    return ref;
+}
+
+/*
+ * Appends a string to the heap and returns its reference. Interned strings
+ * (event types, article names) are stored once. Reference 0 is always "".
+ */
+uint32_t canon_store_add_string(CanonStore* store, const char* str, size_t len, int interned) {
+    if (store->map) return CANON_NO_STRING;
+    if (store->strings_len == 0) {
+        heap_append(store, "", 0);
+        store->event_names[0] = CANON_NO_STRING;
+        store->event_count = 1;
+    }
+    if (!str || len == 0) return CANON_NO_STRING;
+    if (!interned) return heap_append(store, str, len);
+    
+    if (store->intern_used * 2 >= store->intern_cap && intern_grow(store) < 0) {
+        return heap_append(store, str, len);
+    }
+    size_t mask = store->intern_cap - 1;
+    size_t slot = hash_bytes(str, len) & mask;
+    while (store->intern[slot]) {
+        if (string_equals(store, store->intern[slot], str, len)) return store->intern[slot];
+        slot = (slot + 1) & mask;
+    }
+    uint32_t ref = heap_append(store, str, len);
+    if (ref != CANON_NO_STRING) {
+        store->intern[slot] = ref;
+        store->intern_used++;
+    }
+    return ref;
+}
+
+static uint8_t event_index(CanonStore* store, const char* name, size_t len) {
+    uint32_t ref = canon_store_add_string(store, name, len, 1);
+    if (ref == CANON_NO_STRING) return 0;
+    for (uint32_t i = 1; i < store->event_count; i++) {
+        if (store->event_names[i] == ref) return (uint8_t)i;
+    }
+    if (store->event_count >= CANON_MAX_EVENT_TYPES) return 0;
+    store->event_names[store->event_count] = ref;
+    return (uint8_t)store->event_count++;
+}
+
+int canon_store_append(CanonStore* store, const CanonRecord* record) {
+    if (store->map) return -1;
+    if (store->count >= store->capacity) {
+        if (store_grow(store, store->capacity ? store->capacity * 2 : 1024) < 0) return -1;
+    }
+    canon_store_add_string(store, NULL, 0, 0);
+    
+    size_t i = store->count;
+    store->matrix[i] = canon_pack_matrix(record->matrix);
+    store->angle[i] = canon_quantize_angle(record->angle);
+    store->seed[i] = canon_make_seed(store->matrix[i], record->angle);
+    store->timestamp[i] = record->timestamp;
+    store->chapter[i] = record->chapter;
+    store->verse[i] = record->verse;
+    store->event[i] = event_index(store, record->event, record->event_len);
+    store->article[i] = canon_store_add_string(store, record->article, record->article_len, 1);
+    store->id[i] = canon_store_add_string(store, record->id, record->id_len, 0);
+    store->text[i] = canon_store_add_string(store, record->text, record->text_len, 0);
+    store->record[i] = canon_store_add_string(store, record->record, record->record_len, 0);
+    store->count++;
+    return 0;
+}
+
+/*
+ * Splices src's whole string heap onto store's and fills remap with the
+ * offset and event numbering needed to copy src rows with append_row.
+ */
+int canon_store_import_strings(CanonStore* store, const CanonStore* src, CanonStoreRemap* remap) {
+    if (store->map) return -1;
+    canon_store_add_string(store, NULL, 0, 0);
+    memset(remap, 0, sizeof(*remap));
+    if (src->strings_len == 0) return 0;
+    
+    if (store->strings_len + src->strings_len > UINT32_MAX) return -1;
+    if (canon_store_reserve_strings(store, store->strings_len + src->strings_len) < 0) return -1;
+    remap->base = (uint32_t)store->strings_len;
+    memcpy(store->strings + store->strings_len, src->strings, src->strings_len);
+    store->strings_len += src->strings_len;
+    
+    for (uint32_t i = 1; i < src->event_count; i++) {
+        size_t len;
+        const char* name = canon_store_string(src, src->event_names[i], &len);
+        remap->events[i] = event_index(store, name, len);
+    }
+    return 0;
+}
+
+/*
+ * Like import_strings, but takes over src's heap and intern table instead of
+ * copying them when store has no strings yet. src keeps its rows but must
+ * not be read through its string references afterwards.
+ */
+int canon_store_adopt_strings(CanonStore* store, CanonStore* src, CanonStoreRemap* remap) {
+    if (store->map || src->map || store->strings_len != 0 || src->strings_len == 0) {
+        return canon_store_import_strings(store, src, remap);
+    }
+    free(store->strings);
+    free(store->intern);
+    store->strings = src->strings;
+    store->strings_len = src->strings_len;
+    store->strings_cap = src->strings_cap;
+    store->intern = src->intern;
+    store->intern_cap = src->intern_cap;
+    store->intern_used = src->intern_used;
+    memcpy(store->event_names, src->event_names, sizeof(store->event_names));
+    store->event_count = src->event_count;
+    src->strings = NULL;
+    src->strings_len = src->strings_cap = 0;
+    src->intern = NULL;
+    src->intern_cap = src->intern_used = 0;
+    
+    memset(remap, 0, sizeof(*remap));
+    for (uint32_t i = 1; i < store->event_count; i++) remap->events[i] = (uint8_t)i;
+    return 0;
+}
+
+static inline uint32_t remap_ref(const CanonStoreRemap* remap, uint32_t ref) {
+    return ref == CANON_NO_STRING ? CANON_NO_STRING : ref + remap->base;
+}
+
+/* Copies one row of src whose strings were imported with import_strings. */
+int canon_store_append_row(CanonStore* store, const CanonStore* src, size_t row,
+                           const CanonStoreRemap* remap) {
+    if (store->map) return -1;
+    if (store->count >= store->capacity) {
+        if (store_grow(store, store->capacity ? store->capacity * 2 : 1024) < 0) return -1;
+    }
+    
+    size_t i = store->count;
+    store->matrix[i] = src->matrix[row];
+    store->angle[i] = src->angle[row];
+    store->seed[i] = src->seed[row];
+    store->timestamp[i] = src->timestamp[row];
+    store->chapter[i] = src->chapter[row];
+    store->verse[i] = src->verse[row];
+    store->event[i] = remap->events[src->event[row]];
+    store->article[i] = remap_ref(remap, src->article[row]);
+    store->id[i] = remap_ref(remap, src->id[row]);
+    store->text[i] = remap_ref(remap, src->text[row]);
+    store->record[i] = remap_ref(remap, src->record[row]);
+    store->count++;
+    return 0;
+}
+
+static uint64_t align_up(uint64_t value) {
+    return (value + CANON_BIN_ALIGN - 1) & ~(uint64_t)(CANON_BIN_ALIGN - 1);
+}
+
+static int write_column(FILE* file, uint64_t offset, const void* data, size_t len) {
+    if (fseek(file, (long)offset, SEEK_SET) < 0) return -1;
+    return len == 0 || fwrite(data, 1, len, file) == len ? 0 : -1;
+}
+
+/* Written to a temp file and renamed so a running server never maps a torn file. */
+int canon_store_save(const CanonStore* store, const char* path,
+                     const CanonSource* sources, size_t source_count) {
+    if (source_count == 0 || source_count > CANON_MAX_SOURCES) return -1;
+    size_t n = store->count;
+    CanonBinHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CANON_BIN_MAGIC, sizeof(header.magic));
+    header.version = CANON_BIN_VERSION;
+    header.endian = CANON_BIN_ENDIAN;
+    header.count = n;
+    header.source_fingerprint = canon_sources_hash(sources, source_count);
+    header.matrix_offset = align_up(sizeof(header));
+    header.angle_offset = align_up(header.matrix_offset + n * sizeof(uint16_t));
+    header.seed_offset = align_up(header.angle_offset + n * sizeof(uint16_t));
+    header.timestamp_offset = align_up(header.seed_offset + n * sizeof(uint32_t));
+    header.event_offset = align_up(header.timestamp_offset + n * sizeof(uint64_t));
+    header.chapter_offset = align_up(header.event_offset + n * sizeof(uint8_t));
+    header.verse_offset = align_up(header.chapter_offset + n * sizeof(uint16_t));
+    header.article_offset = align_up(header.verse_offset + n * sizeof(uint16_t));
+    header.id_offset = align_up(header.article_offset + n * sizeof(uint32_t));
+    header.text_offset = align_up(header.id_offset + n * sizeof(uint32_t));
+    header.record_offset = align_up(header.text_offset + n * sizeof(uint32_t));
+    header.strings_offset = align_up(header.record_offset + n * sizeof(uint32_t));
+    header.strings_len = store->strings_len;
+    header.sources_offset = align_up(header.strings_offset + store->strings_len);
+    header.source_count = (uint32_t)source_count;
+    header.event_count = store->event_count;
+    memcpy(header.event_names, store->event_names, sizeof(header.event_names));
+    
+    char tmp_path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE* file = fopen(tmp_path, "wb");
+    if (!file) return -1;
+    
+    int rc = write_column(file, 0, &header, sizeof(header));
+    if (rc == 0) rc = write_column(file, header.matrix_offset, store->matrix, n * sizeof(uint16_t));
+    if (rc == 0) rc = write_column(file, header.angle_offset, store->angle, n * sizeof(uint16_t));
+    if (rc == 0) rc = write_column(file, header.seed_offset, store->seed, n * sizeof(uint32_t));
+    if (rc == 0) rc = write_column(file, header.timestamp_offset, store->timestamp, n * sizeof(uint64_t));
+    if (rc == 0) rc = write_column(file, header.event_offset, store->event, n * sizeof(uint8_t));
+    if (rc == 0) rc = write_column(file, header.chapter_offset, store->chapter, n * sizeof(uint16_t));
+    if (rc == 0) rc = write_column(file, header.verse_offset, store->verse, n * sizeof(uint16_t));
+    if (rc == 0) rc = write_column(file, header.article_offset, store->article, n * sizeof(uint32_t));
+    if (rc == 0) rc = write_column(file, header.id_offset, store->id, n * sizeof(uint32_t));
+    if (rc == 0) rc = write_column(file, header.text_offset, store->text, n * sizeof(uint32_t));
+    if (rc == 0) rc = write_column(file, header.record_offset, store->record, n * sizeof(uint32_t));
+    if (rc == 0) rc = write_column(file, header.strings_offset, store->strings, store->strings_len);
+    if (rc == 0) rc = write_column(file, header.sources_offset, sources, source_count * sizeof(CanonSource));
+    if (fclose(file) != 0) rc = -1;
+    
+    if (rc == 0 && rename(tmp_path, path) < 0) rc = -1;
+    if (rc < 0) unlink(tmp_path);
+    return rc;
+}
+
+/* Whether count elements of width bytes at offset lie inside a file of size bytes, aligned for their type. */
+static int column_fits(uint64_t offset, uint64_t count, size_t width, uint64_t size) {
+    return offset <= size && offset % width == 0 && count <= (size - offset) / width;
+}
+
+/*
+ * Every column and the string heap must lie inside the file, since a
+ * fingerprint match only says the sources are unchanged, not that the
+ * cache was written out in full.
+ */
+static int header_fits(const CanonBinHeader* header, uint64_t size) {
+    uint64_t count = header->count;
+    if (!column_fits(header->matrix_offset, count, sizeof(uint16_t), size) ||
+        !column_fits(header->angle_offset, count, sizeof(uint16_t), size) ||
+        !column_fits(header->seed_offset, count, sizeof(uint32_t), size) ||
+        !column_fits(header->timestamp_offset, count, sizeof(uint64_t), size) ||
+        !column_fits(header->event_offset, count, sizeof(uint8_t), size) ||
+        !column_fits(header->chapter_offset, count, sizeof(uint16_t), size) ||
+        !column_fits(header->verse_offset, count, sizeof(uint16_t), size) ||
+        !column_fits(header->article_offset, count, sizeof(uint32_t), size) ||
+        !column_fits(header->id_offset, count, sizeof(uint32_t), size) ||
+        !column_fits(header->text_offset, count, sizeof(uint32_t), size) ||
+        !column_fits(header->record_offset, count, sizeof(uint32_t), size) ||
+        !column_fits(header->strings_offset, header->strings_len, 1, size) ||
+        /* Read with pread, never mapped, so only its extent matters. */
+        !column_fits(header->sources_offset, (uint64_t)header->source_count * sizeof(CanonSource), 1, size)) {
+        return 0;
+    }
+    return 1;
+}
+
+/* A string is its u32 length, the bytes and a NUL, all inside the heap. */
+static int string_fits(const char* strings, uint64_t len, uint32_t ref) {
+    uint32_t n;
+    if (len < sizeof(n) + 1 || ref > len - sizeof(n) - 1) return 0;
+    memcpy(&n, strings + ref, sizeof(n));
+    return n <= len - ref - sizeof(n) - 1 && strings[ref + sizeof(n) + n] == '\0';
+}
+
+/*
+ * canon_store_string and canon_store_event_name trust what they are given,
+ * so every string a row or the event table refers to must be whole and
+ * every row's event must name a known type before the file is used.
+ */
+static int refs_fit(const CanonBinHeader* header, const char* base) {
+    const char* strings = base + header->strings_offset;
+    uint64_t len = header->strings_len;
+    for (uint32_t i = 0; i < header->event_count; i++) {
+        if (!string_fits(strings, len, header->event_names[i])) return 0;
+    }
+    const uint8_t* event = (const uint8_t*)(base + header->event_offset);
+    const uint32_t* article = (const uint32_t*)(base + header->article_offset);
+    const uint32_t* id = (const uint32_t*)(base + header->id_offset);
+    const uint32_t* text = (const uint32_t*)(base + header->text_offset);
+    const uint32_t* record = (const uint32_t*)(base + header->record_offset);
+    for (uint64_t i = 0; i < header->count; i++) {
+        if (event[i] >= header->event_count ||
+            !string_fits(strings, len, article[i]) || !string_fits(strings, len, id[i]) ||
+            !string_fits(strings, len, text[i]) || !string_fits(strings, len, record[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int header_valid(const CanonBinHeader* header, uint64_t size) {
+    return memcmp(header->magic, CANON_BIN_MAGIC, sizeof(header->magic)) == 0 &&
+           header->version == CANON_BIN_VERSION &&
+           header->endian == CANON_BIN_ENDIAN &&
+           header->event_count <= CANON_MAX_EVENT_TYPES &&
+           header->source_count <= CANON_MAX_SOURCES &&
+           header_fits(header, size);
+}
+
+/*
+ * Reads the source table of a canon.bin without mapping the rest, so a
+ * caller can tell whether it is current from a few stat() calls. Returns
+ * the number of sources, or -1 when the file is missing or not valid.
+ */
+int canon_store_sources(const char* path, CanonSource* sources, size_t cap) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    
+    struct stat st;
+    CanonBinHeader header;
+    int count = -1;
+    if (fstat(fd, &st) == 0 &&
+        pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+        header_valid(&header, (uint64_t)st.st_size) && header.source_count <= cap) {
+        size_t len = header.source_count * sizeof(CanonSource);
+        if (pread(fd, sources, len, (off_t)header.sources_offset) == (ssize_t)len) {
+            count = (int)header.source_count;
+            for (int i = 0; i < count; i++) {
+                if (memchr(sources[i].path, '\0', sizeof(sources[i].path)) == NULL) count = -1;
+            }
+        }
+    }
+    close(fd);
+    return count;
+}
+
+/*
+ * Maps a canon.bin in place. Fails unless fingerprint is the hash of the
+ * sources it was built from (see canon_store_sources).
+ */
+int canon_store_map(CanonStore* store, const char* path, uint64_t fingerprint) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(CanonBinHeader)) {
+        close(fd);
+        return -1;
+    }
+    
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    
+    const CanonBinHeader* header = map;
+    if (!header_valid(header, (uint64_t)st.st_size) || header->source_fingerprint != fingerprint ||
+        !refs_fit(header, map)) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    
+    char* base = map;
+    canon_store_free(store);
+    store->map = map;
+    store->map_len = st.st_size;
+    store->count = header->count;
+    store->capacity = header->count;
+    store->matrix = (uint16_t*)(base + header->matrix_offset);
+    store->angle = (uint16_t*)(base + header->angle_offset);
+    store->seed = (uint32_t*)(base + header->seed_offset);
+    store->timestamp = (uint64_t*)(base + header->timestamp_offset);
+    store->event = (uint8_t*)(base + header->event_offset);
+    store->chapter = (uint16_t*)(base + header->chapter_offset);
+    store->verse = (uint16_t*)(base + header->verse_offset);
+    store->article = (uint32_t*)(base + header->article_offset);
+    store->id = (uint32_t*)(base + header->id_offset);
+    store->text = (uint32_t*)(base + header->text_offset);
+    store->record = (uint32_t*)(base + header->record_offset);
+    store->strings = base + header->strings_offset;
+    store->strings_len = header->strings_len;
+    store->event_count = header->event_count;
+    memcpy(store->event_names, header->event_names, sizeof(store->event_names));
+    return 0;
+}
+
+uint64_t canon_file_fingerprint(const char* path) {
+    struct stat st;
+    if (stat(path, &st) < 0) return 0;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint64_t parts[3] = { (uint64_t)st.st_size, (uint64_t)st.st_mtim.tv_sec, (uint64_t)st.st_mtim.tv_nsec };
+    for (int i = 0; i < 3; i++) {
+        hash ^= parts[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/* FNV-1a over every path and fingerprint, in order. */
+uint64_t canon_sources_hash(const CanonSource* sources, size_t count) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < count; i++) {
+        for (const char* p = sources[i].path; *p; p++) {
+            hash ^= (unsigned char)*p;
+            hash *= 0x100000001b3ULL;
+        }
+        hash ^= sources[i].fingerprint;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,181 @@
+#ifndef CANON_STORE_H
+#define CANON_STORE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define CANON_BIN_MAGIC "FANOCAN1"
+#define CANON_BIN_VERSION 4
+#define CANON_MAX_EVENT_TYPES 255
+#define CANON_MAX_SOURCES 64
+#define CANON_SOURCE_PATH_MAX 256
+#define CANON_NO_STRING 0
+#define CANON_BIN_ENDIAN 0x01020304u
+
+/*
+ * Struct-of-arrays canon: one column per field. The playback columns take
+ * 16 bytes per chunk: matrix packs the seven 2-bit quadrants (point 0 in the
+ * low bits) and angle holds degrees scaled to the full u16 range. The schema
+ * columns hold references into a string heap: the interned event type and
+ * article, the record id, its text and the complete source record, so no
+ * field of the NDJSON line is lost. Columns either own heap memory or point
+ * into a read-only mapping of a canon.bin file.
+ */
+typedef struct {
+    size_t count;
+    size_t capacity;
+    uint16_t* matrix;
+    uint16_t* angle;
+    uint32_t* seed;
+    uint64_t* timestamp;
+    uint8_t* event;
+    uint16_t* chapter;
+    uint16_t* verse;
+    uint32_t* article;
+    uint32_t* id;
+    uint32_t* text;
+    uint32_t* record;
+    char* strings;
+    size_t strings_len;
+    size_t strings_cap;
+    uint32_t event_names[CANON_MAX_EVENT_TYPES];
+    uint32_t event_count;
+    uint32_t* intern;
+    size_t intern_cap;
+    size_t intern_used;
+    void* map;
+    size_t map_len;
+} CanonStore;
+
+/* One parsed NDJSON line, as handed to canon_store_append. */
+typedef struct {
+    uint8_t matrix[7];
+    float angle;
+    uint64_t timestamp;
+    uint16_t chapter;
+    uint16_t verse;
+    const char* event;
+    size_t event_len;
+    const char* article;
+    size_t article_len;
+    const char* id;
+    size_t id_len;
+    const char* text;
+    size_t text_len;
+    const char* record;
+    size_t record_len;
+} CanonRecord;
+
+/* A file a canon was built from, with its canon_file_fingerprint from just before it was read. */
+typedef struct {
+    uint64_t fingerprint;
+    char path[CANON_SOURCE_PATH_MAX];
+} CanonSource;
+
+/*
+ * canon.bin: this header, the columns and the string heap, each aligned,
+ * then the table of sources the canon was built from. source_fingerprint
+ * is canon_sources_hash of that table, so the table read up front and the
+ * columns mapped later are known to belong together.
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint64_t count;
+    uint64_t source_fingerprint;
+    uint64_t matrix_offset;
+    uint64_t angle_offset;
+    uint64_t seed_offset;
+    uint64_t timestamp_offset;
+    uint64_t event_offset;
+    uint64_t chapter_offset;
+    uint64_t verse_offset;
+    uint64_t article_offset;
+    uint64_t id_offset;
+    uint64_t text_offset;
+    uint64_t record_offset;
+    uint64_t strings_offset;
+    uint64_t strings_len;
+    uint64_t sources_offset;
+    uint32_t source_count;
+    uint32_t event_count;
+    uint32_t event_names[CANON_MAX_EVENT_TYPES];
+} CanonBinHeader;
+
+/* How rows of another store map into this one after import_strings. */
+typedef struct {
+    uint32_t base;
+    uint8_t events[CANON_MAX_EVENT_TYPES];
+} CanonStoreRemap;
+
+void canon_store_init(CanonStore* store);
+void canon_store_free(CanonStore* store);
+int canon_store_append(CanonStore* store, const CanonRecord* record);
+int canon_store_import_strings(CanonStore* store, const CanonStore* src, CanonStoreRemap* remap);
+int canon_store_adopt_strings(CanonStore* store, CanonStore* src, CanonStoreRemap* remap);
+int canon_store_append_row(CanonStore* store, const CanonStore* src, size_t row,
+                           const CanonStoreRemap* remap);
+int canon_store_reserve(CanonStore* store, size_t count);
+int canon_store_reserve_strings(CanonStore* store, size_t bytes);
+uint32_t canon_store_add_string(CanonStore* store, const char* str, size_t len, int interned);
+int canon_store_save(const CanonStore* store, const char* path,
+                     const CanonSource* sources, size_t source_count);
+int canon_store_sources(const char* path, CanonSource* sources, size_t cap);
+int canon_store_map(CanonStore* store, const char* path, uint64_t fingerprint);
+uint64_t canon_file_fingerprint(const char* path);
+uint64_t canon_sources_hash(const CanonSource* sources, size_t count);
+
+static inline uint16_t canon_pack_matrix(const uint8_t matrix[7]) {
+    uint16_t packed = 0;
+    for (int i = 0; i < 7; i++) {
+        packed |= (uint16_t)((matrix[i] & 3) << (i * 2));
+    }
+    return packed;
+}
+
+static inline void canon_unpack_matrix(uint16_t packed, uint8_t matrix[7]) {
+    for (int i = 0; i < 7; i++) {
+        matrix[i] = (packed >> (i * 2)) & 3;
+    }
+}
+
+static inline uint16_t canon_quantize_angle(float angle) {
+    float turns = angle / 360.0f;
+    turns -= (float)(int64_t)turns;
+    if (turns < 0) turns += 1.0f;
+    return (uint16_t)((uint32_t)(turns * 65536.0f + 0.5f) & 0xFFFF);
+}
+
+static inline float canon_angle_degrees(uint16_t quantized) {
+    return (float)quantized * (360.0f / 65536.0f);
+}
+
+/* Same layout the loader has always produced: 14 quadrant bits, 10 angle bits. */
+static inline uint32_t canon_make_seed(uint16_t packed_matrix, float angle) {
+    uint32_t angle_bits = ((uint32_t)((angle / 360.0) * 1023)) & 0x3FF;
+    return ((uint32_t)packed_matrix << 10) | angle_bits;
+}
+
+static inline void canon_store_matrix(const CanonStore* store, size_t index, uint8_t matrix[7]) {
+    canon_unpack_matrix(store->matrix[index], matrix);
+}
+
+static inline float canon_store_angle(const CanonStore* store, size_t index) {
+    return canon_angle_degrees(store->angle[index]);
+}
+
+/* Strings are stored as a u32 length, the bytes and a terminating NUL. */
+static inline const char* canon_store_string(const CanonStore* store, uint32_t ref, size_t* len) {
+    uint32_t n;
+    memcpy(&n, store->strings + ref, sizeof(n));
+    if (len) *len = n;
+    return store->strings + ref + sizeof(uint32_t);
+}
+
+static inline const char* canon_store_event_name(const CanonStore* store, size_t index) {
+    return canon_store_string(store, store->event_names[store->event[index]], NULL);
+}
+
+#endif
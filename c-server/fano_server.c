@@ -1,11 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
 #include <pthread.h>
 #include <signal.h>
 #include <time.h>
@@ -13,126 +17,181 @@
 #include <errno.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <stdatomic.h>
+#include <math.h>
 
 #include "memory_pool.h"
+#include "arena.h"
+#include "router.h"
+#include "http_parser.h"
 #include "websocket.h"
+#include "broadcast.h"
+#include "sse.h"
+#include "asset_cache.h"
+#include "out_queue.h"
+#include "canon_store.h"
+#include "canon_snapshot.h"
+#include "canon_export.h"
+#include "session.h"
 
 #define MAX_EVENTS 10000
 #define PORT 8080
 #define WS_PORT 8081
 #define BUFFER_SIZE 65536
-#define MAX_PATH 256
+#define BUFFER_INITIAL 1024
 #define MAX_CLIENTS 10000
-#define MAX_CHUNKS 100000
 #define CANON_TICK_MS 100
+#define CANON_FRAME_MS 10
+#define CANON_MANIFEST "../canon-manifest.ndjson"
+#define CANON_BIN_PATH "storage/canon.bin"
+#define MAX_WORKERS 64
+#define KEEPALIVE_TIMEOUT_S 5
+#define SEND_TIMEOUT_S 30                     /* a reader taking no bytes for this long is dropped */
+#define KEEPALIVE_MAX_REQUESTS 1000
+#define OUTPUT_HIGH_WATER (256 * 1024)
+#define CLIENT_POOL_SLAB 1024
+#define METRICS_RESPONSE_MAX (32 * 1024)
+#define EXPORT_FRAME 10                       /* "%08x\r\n" ahead of each HTTP chunk */
 
-typedef struct {
-    char path[MAX_PATH];
-    uint8_t matrix[7];
-    float angle;
-    uint64_t timestamp;
-    uint32_t seed;
-} CanonChunk;
+#define STR_(x) #x
+#define STR(x) STR_(x)
 
-typedef struct {
-    CanonChunk* chunks;
-    size_t count;
-    size_t capacity;
-    uint32_t current_index;
-    uint8_t playing;
-    float speed;
-} CanonState;
+/*
+ * The read buffer starts at BUFFER_INITIAL bytes and doubles up to
+ * BUFFER_SIZE while a request needs it; it drops back to the small size
+ * once the connection has nothing buffered. request is the parse of the
+ * request starting at buffer_pos, kept across reads until it completes.
+ * Handlers take their scratch memory from arena, which is reset after
+ * every request. While export_snap is set the connection is sending a
+ * /api/chunks range and holds that snapshot until the last row is queued.
+ * A connection that is not streaming waits on one of its worker's deadline
+ * lists (see deadline_touch).
+ */
+struct Client;
 
 typedef struct {
+    struct Client* head;
+    struct Client* tail;
+} ClientList;
+
+typedef struct Client {
     int fd;
-    char buffer[BUFFER_SIZE];
+    char* buffer;
+    size_t buffer_cap;
     size_t buffer_len;
     size_t buffer_pos;
+    HttpRequest request;
+    Arena arena;
     uint64_t last_active;
+    uint32_t requests_served;
+    uint8_t keep_alive;
+    uint8_t head_only;
+    uint8_t closing;
+    uint8_t streaming;
+    BroadcastResumeRequest stream_request;
+    char stream_session[SESSION_ID_MAX];
+    OutQueue out;
+    CanonSnapshot* export_snap;
+    CanonExport export;
+    uint8_t export_chunked;
     uint8_t authenticated;
     char role[16];
     char peer_id[64];
+    ClientList* deadline;
+    struct Client* deadline_prev;
+    struct Client* deadline_next;
+    struct Client* stream_prev;
+    struct Client* stream_next;
 } Client;
 
+/* Player timer health: how late each frame woke and how many were missed. */
+typedef struct {
+    _Atomic uint64_t frames;
+    _Atomic uint64_t overruns;
+    _Atomic uint64_t jitter_total_ns;
+    _Atomic uint64_t jitter_max_ns;
+    _Atomic uint64_t jitter_last_ns;
+} PlayerClock;
+
 typedef struct {
+    _Atomic uint64_t accepted;
+    _Atomic uint64_t requests;
+    _Atomic uint64_t closed;
+    _Atomic uint64_t active;
+    _Atomic uint64_t streams;
+} WorkerStats;
+
+struct ServerState;
+
+typedef struct {
+    int id;
     int epoll_fd;
     int server_fd;
-    Client* clients[MAX_CLIENTS];
-    CanonState canon;
-    pthread_mutex_t canon_mutex;
+    Client** clients;
+    ClientList idle;
+    ClientList sending;
+    int event_fd;
+    int sse_waker;
+    uint64_t sse_seq;
+    Client* streams;
+    uint64_t heartbeat_at;
+    pthread_t thread;
+    WorkerStats stats;
+    struct ServerState* server;
+} Worker;
+
+typedef struct ServerState {
+    Worker workers[MAX_WORKERS];
+    int worker_count;
+    SessionTable sessions;
+    CanonPublisher canon_source;
+    PlayerClock clock;
     uint8_t running;
+    BroadcastRing events;
     WSContext ws;
+    SSEContext sse;
+    AssetCache assets;
+    Router router;
+    MemoryPool* client_pool;
 } ServerState;
 
+static volatile sig_atomic_t stop_requested = 0;
+
+static inline void stat_add(_Atomic uint64_t* counter, int64_t delta) {
+    atomic_fetch_add_explicit(counter, (uint64_t)delta, memory_order_relaxed);
+}
+
+static inline uint64_t stat_get(_Atomic uint64_t* counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static uint64_t monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec;
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
 static const uint8_t FANO_HUES[8] = {0, 30, 60, 120, 240, 150, 44, 0};
 static const char* FANO_NAMES[8] = {
     "Metatron", "Solomon", "Solon", "Asabiyyah",
     "Enoch", "Speaker", "Genesis", "Observer"
 };
 
-static int load_canon(CanonState* canon, const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "Failed to open %s\n", filename);
-        return -1;
-    }
-    
-    canon->capacity = 1000;
-    canon->chunks = malloc(sizeof(CanonChunk) * canon->capacity);
-    if (!canon->chunks) {
-        fclose(file);
-        return -1;
-    }
-    canon->count = 0;
-    
-    char line[4096];
-    while (fgets(line, sizeof(line), file)) {
-        if (canon->count >= canon->capacity) {
-            canon->capacity *= 2;
-            CanonChunk* new_chunks = realloc(canon->chunks, sizeof(CanonChunk) * canon->capacity);
-            if (!new_chunks) {
-                fclose(file);
-                return -1;
-            }
-            canon->chunks = new_chunks;
-        }
-        
-        CanonChunk* chunk = &canon->chunks[canon->count];
-        memset(chunk, 0, sizeof(CanonChunk));
-        
-        char* matrix_start = strstr(line, "\"matrix\":[");
-        if (matrix_start) {
-            matrix_start += 9;
-            for (int i = 0; i < 7; i++) {
-                chunk->matrix[i] = atoi(matrix_start);
-                matrix_start = strchr(matrix_start, ',');
-                if (matrix_start) matrix_start++;
-                else break;
-            }
-        }
-        
-        char* angle_start = strstr(line, "\"angle\":");
-        if (angle_start) {
-            angle_start += 7;
-            chunk->angle = atof(angle_start);
-        }
-        
-        chunk->timestamp = (uint64_t)time(NULL) * 1000 + canon->count * 100;
-        
-        uint32_t quadrant_bits = 0;
-        for (int i = 0; i < 7; i++) {
-            quadrant_bits |= (chunk->matrix[i] & 3) << (i * 2);
-        }
-        uint32_t angle_bits = ((uint32_t)((chunk->angle / 360.0) * 1023)) & 0x3FF;
-        chunk->seed = (quadrant_bits << 10) | angle_bits;
-        
-        canon->count++;
-    }
-    
-    fclose(file);
-    printf("Loaded %zu canon chunks from %s\n", canon->count, filename);
-    return 0;
-}
+static const AssetRoute ASSET_ROUTES[] = {
+    {{"/composer", "/composer.html"}, "public/composer.html", "text/html"},
+    {{"/composer.js"}, "public/composer.js", "application/javascript"},
+    {{"/composer.css"}, "public/composer.css", "text/css"},
+    {{"/pipe.js"}, "public/pipe.js", "application/javascript"},
+    {{"/fano-editor.js"}, "public/fano-editor.js", "application/javascript"},
+    {{"/firmware.html", "/fano-minimal.html"}, "public/fano-minimal.html", "text/html"},
+    {{"/interplanetary", "/demo"}, "public/interplanetary-demo/player.html", "text/html"},
+};
 
 static int create_server_socket(int port) {
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
@@ -140,6 +199,10 @@ static int create_server_socket(int port) {
     
     int opt = 1;
     setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+#ifdef SO_REUSEPORT
+    /* Every worker binds its own listener; the kernel spreads accepts across them. */
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+#endif
     
     struct sockaddr_in addr = {
         .sin_family = AF_INET,
@@ -162,524 +225,1174 @@ static int create_server_socket(int port) {
     return server_fd;
 }
 
-static void send_response(int client_fd, const char* status, const char* content_type, const char* body, size_t body_len) {
+static const char* connection_header(const Client* client) {
+    if (client->keep_alive) {
+        return "Connection: keep-alive\r\n"
+               "Keep-Alive: timeout=" STR(KEEPALIVE_TIMEOUT_S) ", max=" STR(KEEPALIVE_MAX_REQUESTS) "\r\n";
+    }
+    return "Connection: close\r\n";
+}
+
+/* Writes str as a JSON string body (no quotes); returns the bytes used. */
+static size_t json_escape(char* out, size_t cap, const char* str, size_t len) {
+    size_t n = 0;
+    for (size_t i = 0; i < len && n + 7 < cap; i++) {
+        unsigned char c = (unsigned char)str[i];
+        if (c == '"' || c == '\\') {
+            out[n++] = '\\';
+            out[n++] = (char)c;
+        } else if (c < 0x20) {
+            n += (size_t)snprintf(out + n, cap - n, "\\u%04x", c);
+        } else {
+            out[n++] = (char)c;
+        }
+    }
+    out[n] = '\0';
+    return n;
+}
+
+static void send_response(Client* client, const char* status, const char* content_type, const char* body, size_t body_len) {
     char header[512];
     int header_len = snprintf(header, sizeof(header),
         "HTTP/1.1 %s\r\n"
         "Content-Type: %s\r\n"
         "Content-Length: %zu\r\n"
         "Access-Control-Allow-Origin: *\r\n"
-        "Connection: close\r\n"
+        "%s"
         "\r\n",
-        status, content_type, body_len);
+        status, content_type, body_len, connection_header(client));
     
-    write(client_fd, header, header_len);
-    if (body && body_len > 0) {
-        write(client_fd, body, body_len);
+    outq_push_copy(&client->out, header, header_len);
+    if (body && body_len > 0 && !client->head_only) {
+        outq_push_copy(&client->out, body, body_len);
     }
 }
 
-static void send_json(int client_fd, const char* json) {
-    send_response(client_fd, "200 OK", "application/json", json, strlen(json));
+static void send_json(Client* client, const char* json) {
+    send_response(client, "200 OK", "application/json", json, strlen(json));
+}
+
+static void send_not_found(Client* client) {
+    send_response(client, "404 Not Found", "text/plain", "Not Found", 9);
+}
+
+static void send_ok(Client* client) {
+    send_response(client, "200 OK", "text/plain", "OK", 2);
 }
 
-static void send_not_found(int client_fd) {
-    send_response(client_fd, "404 Not Found", "text/plain", "Not Found", 9);
+static void release_asset_blob(void* blob) {
+    asset_blob_release((AssetBlob*)blob);
 }
 
-static void send_ok(int client_fd) {
-    send_response(client_fd, "200 OK", "text/plain", "OK", 2);
+/* The body is queued by reference; the segment keeps the blob alive. */
+static void send_asset(Client* client, AssetBlob* blob) {
+    const char* connection = connection_header(client);
+    outq_push_copy(&client->out, blob->header, blob->header_len);
+    outq_push_copy(&client->out, connection, strlen(connection));
+    outq_push_copy(&client->out, "\r\n", 2);
+    if (client->head_only) return;
+    atomic_fetch_add_explicit(&blob->refs, 1, memory_order_relaxed);
+    outq_push_ref(&client->out, blob->body, blob->body_len, release_asset_blob, blob);
 }
 
-static void handle_api_request(ServerState* state, Client* client, char* path) {
-    char response[4096];
-    int len;
+/* Zero-copy delivery: the body never passes through userspace. etag may be NULL. */
+static int serve_file(Client* client, const char* filename, const char* content_type, const char* etag) {
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
     
-    if (strcmp(path, "/") == 0 || strcmp(path, "/index.html") == 0 || strcmp(path, "/api") == 0) {
-        len = snprintf(response, sizeof(response),
-            "{\"server\":\"Fano Garden C Server\",\"port\":%d,\"chunks\":%zu}",
-            PORT, state->canon.count);
-        response[len] = '\0';
-        send_json(client->fd, response);
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    
+    char header[512];
+    int header_len = snprintf(header, sizeof(header),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: %s\r\n"
+        "Content-Length: %lld\r\n"
+        "%s%s%s"
+        "Cache-Control: no-cache\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "%s"
+        "\r\n",
+        content_type, (long long)st.st_size, etag ? "ETag: " : "", etag ? etag : "", etag ? "\r\n" : "",
+        connection_header(client));
+    outq_push_copy(&client->out, header, header_len);
+    if (client->head_only) {
+        close(fd);
+        return 0;
     }
-    else if (strcmp(path, "/api/canon") == 0 || strcmp(path, "/api/canon.json") == 0) {
-        pthread_mutex_lock(&state->canon_mutex);
-        len = snprintf(response, sizeof(response),
-            "{\"chunks\":%zu,\"current\":%u,\"playing\":%d,\"speed\":%.1f}",
-            state->canon.count, state->canon.current_index, state->canon.playing, state->canon.speed);
-        pthread_mutex_unlock(&state->canon_mutex);
-        response[len] = '\0';
-        send_json(client->fd, response);
+    return outq_push_file(&client->out, fd, 0, st.st_size);
+}
+
+static void send_not_modified(Client* client, const char* etag) {
+    char header[512];
+    int header_len = snprintf(header, sizeof(header),
+        "HTTP/1.1 304 Not Modified\r\n"
+        "ETag: %s\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "%s"
+        "\r\n",
+        etag, connection_header(client));
+    outq_push_copy(&client->out, header, header_len);
+}
+
+/* For requests the parser refused; status is what http_parse left in the request. */
+static void send_bad_request(Client* client, int status) {
+    const char* line;
+    switch (status) {
+        case 413: line = "413 Content Too Large"; break;
+        case 431: line = "431 Request Header Fields Too Large"; break;
+        case 501: line = "501 Not Implemented"; break;
+        case 505: line = "505 HTTP Version Not Supported"; break;
+        default: line = "400 Bad Request"; break;
     }
-    else if (strcmp(path, "/api/play") == 0) {
-        pthread_mutex_lock(&state->canon_mutex);
-        state->canon.playing = 1;
-        pthread_mutex_unlock(&state->canon_mutex);
-        send_ok(client->fd);
+    send_response(client, line, "text/plain", line + 4, strlen(line + 4));
+}
+
+/* The request being handled; its slices are offsets from here. */
+static char* request_data(const Client* client) {
+    return client->buffer + client->buffer_pos;
+}
+
+static const char* request_header(const Client* client, const char* name, size_t* len) {
+    return http_header(&client->request, request_data(client), name, len);
+}
+
+static void send_session_status(Client* client, PlaybackSession* session, const CanonSnapshot* snap) {
+    char response[512];
+    uint64_t position = atomic_load(&session->position);
+    int len = snprintf(response, sizeof(response),
+        "{\"session\":\"%s\",\"chunks\":%zu,\"current\":%u,\"playing\":%d,\"speed\":%.1f,\"generation\":%lu}",
+        session->id, snap->store.count, CANON_POSITION_INDEX(position), atomic_load(&session->playing),
+        atomic_load(&session->speed), (unsigned long)snap->generation);
+    response[len] = '\0';
+    send_json(client, response);
+}
+
+/* A finite number making up the whole argument, trailing whitespace aside (POST bodies end in a newline). */
+static int parse_command_arg(const char* text, float* value) {
+    char* end;
+    *value = strtof(text, &end);
+    if (end == text) return -1;
+    while (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n') end++;
+    return *end == '\0' && isfinite(*value) ? 0 : -1;
+}
+
+/*
+ * Runs one control command ("play", "pause", "stop", "seek?0.5",
+ * "speed?1.5", "delete", or "" for status) against a named session.
+ * Any control creates the session on first use; status and delete do not.
+ * A seek or speed whose argument is not a finite number is a 400.
+ */
+static void handle_session_command(ServerState* state, Client* client,
+                                   const char* id, size_t id_len, const char* command) {
+    SessionTable* sessions = &state->sessions;
+    int status = command[0] == '\0';
+    if (strcmp(command, "delete") == 0) {
+        if (session_remove(sessions, id, id_len) == 0) send_ok(client);
+        else send_not_found(client);
+        return;
     }
-    else if (strcmp(path, "/api/pause") == 0) {
-        pthread_mutex_lock(&state->canon_mutex);
-        state->canon.playing = 0;
-        pthread_mutex_unlock(&state->canon_mutex);
-        send_ok(client->fd);
+    if (!status && strcmp(command, "play") != 0 && strcmp(command, "pause") != 0 &&
+        strcmp(command, "stop") != 0 && strncmp(command, "seek?", 5) != 0 &&
+        strncmp(command, "speed?", 6) != 0) {
+        send_not_found(client);
+        return;
     }
-    else if (strcmp(path, "/api/stop") == 0) {
-        pthread_mutex_lock(&state->canon_mutex);
-        state->canon.playing = 0;
-        state->canon.current_index = 0;
-        pthread_mutex_unlock(&state->canon_mutex);
-        send_ok(client->fd);
+    float arg = 0.0f;
+    const char* query = strchr(command, '?');
+    if (query && parse_command_arg(query + 1, &arg) < 0) {
+        send_bad_request(client, 400);
+        return;
     }
-    else if (strncmp(path, "/api/seek?", 10) == 0) {
-        float pos = atof(path + 10);
-        pthread_mutex_lock(&state->canon_mutex);
-        if (state->canon.count > 0) {
-            state->canon.current_index = (uint32_t)(pos * state->canon.count);
-            if (state->canon.current_index >= state->canon.count) {
-                state->canon.current_index = state->canon.count - 1;
-            }
-        }
-        pthread_mutex_unlock(&state->canon_mutex);
-        send_ok(client->fd);
-    }
-    else if (strncmp(path, "/api/speed?", 11) == 0) {
-        float speed = atof(path + 11);
-        pthread_mutex_lock(&state->canon_mutex);
-        state->canon.speed = speed;
-        pthread_mutex_unlock(&state->canon_mutex);
-        send_ok(client->fd);
-    }
-    else if (strncmp(path, "/api/chunk/", 11) == 0) {
-        uint32_t index = atoi(path + 11);
-        pthread_mutex_lock(&state->canon_mutex);
-        if (index < state->canon.count) {
-            CanonChunk* chunk = &state->canon.chunks[index];
-            len = snprintf(response, sizeof(response),
-                "{\"index\":%u,\"matrix\":[%d,%d,%d,%d,%d,%d,%d],"
-                "\"angle\":%.2f,\"seed\":%u,\"timestamp\":%lu}",
-                index,
-                chunk->matrix[0], chunk->matrix[1], chunk->matrix[2],
-                chunk->matrix[3], chunk->matrix[4], chunk->matrix[5], chunk->matrix[6],
-                chunk->angle, chunk->seed, (unsigned long)chunk->timestamp);
-            response[len] = '\0';
-            send_json(client->fd, response);
-        } else {
-            pthread_mutex_unlock(&state->canon_mutex);
-            send_not_found(client->fd);
-            return;
-        }
-        pthread_mutex_unlock(&state->canon_mutex);
-    }
-    else if (strncmp(path, "/api/fano/", 10) == 0) {
-        uint8_t point = atoi(path + 10);
-        if (point < 8) {
-            len = snprintf(response, sizeof(response),
-                "{\"point\":%d,\"name\":\"%s\",\"hue\":%d,\"ratio\":%.4f}",
-                point + 1, FANO_NAMES[point], FANO_HUES[point],
-                (float)FANO_HUES[point] / 360.0f);
-            response[len] = '\0';
-            send_json(client->fd, response);
-        } else {
-            send_not_found(client->fd);
-        }
+    
+    PlaybackSession* session = session_get(sessions, id, id_len, !status);
+    if (!session) {
+        send_not_found(client);
+        return;
     }
-    else if (strcmp(path, "/api/ws") == 0) {
-        char ws_info[512];
-        int len = snprintf(ws_info, sizeof(ws_info),
-            "{\"ws_port\":%d,\"protocol\":\"fano-protocol\"}", WS_PORT);
-        send_json(client->fd, ws_info);
-    }
-    else if (strcmp(path, "/api/models") == 0 || strcmp(path, "/api/models.json") == 0) {
-        FILE* mf = fopen("storage/models/index.json", "r");
-        if (mf) {
-            fseek(mf, 0, SEEK_END);
-            long fsize = ftell(mf);
-            fseek(mf, 0, SEEK_SET);
-            char* json = malloc(fsize + 1);
-            fread(json, 1, fsize, mf);
-            json[fsize] = '\0';
-            fclose(mf);
-            send_json(client->fd, json);
-            free(json);
-        } else {
-            send_json(client->fd, "{\"samples\":[],\"error\":\"No models found\"}");
-        }
+    CanonSnapshot* snap = canon_snapshot_acquire(&state->canon_source);
+    if (status) {
+        send_session_status(client, session, snap);
+    } else {
+        if (strcmp(command, "play") == 0) session_play(sessions, session, 1);
+        else if (strcmp(command, "pause") == 0) session_play(sessions, session, 0);
+        else if (strcmp(command, "stop") == 0) session_stop(sessions, session, snap);
+        else if (strncmp(command, "seek?", 5) == 0) session_seek(sessions, session, snap, arg);
+        else session_set_speed(sessions, session, arg);
+        send_ok(client);
     }
-    else if (strcmp(path, "/api/assets") == 0 || strcmp(path, "/api/assets.ndjson") == 0) {
-        FILE* af = fopen("storage/canon-assets.ndjson", "r");
-        if (af) {
-            fseek(af, 0, SEEK_END);
-            long asize = ftell(af);
-            fseek(af, 0, SEEK_SET);
-            char* data = malloc(asize + 1);
-            fread(data, 1, asize, af);
-            data[asize] = '\0';
-            fclose(af);
-            
-            char header[256];
-            int header_len = snprintf(header, sizeof(header),
-                "HTTP/1.1 200 OK\r\n"
-                "Content-Type: application/x-ndjson\r\n"
-                "Content-Length: %ld\r\n"
-                "Access-Control-Allow-Origin: *\r\n"
-                "\r\n", asize);
-            write(client->fd, header, header_len);
-            write(client->fd, data, asize);
-            free(data);
-        } else {
-            send_not_found(client->fd);
+    canon_snapshot_release(snap);
+    session_release(session);
+}
+
+static void send_server_error(Client* client) {
+    send_response(client, "500 Internal Server Error", "text/plain", "Error", 5);
+}
+
+static void send_session_list(ServerState* state, Client* client) {
+    size_t total = 0;
+    size_t cap = 4096;
+    char* ids = NULL;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        ids = arena_alloc(&client->arena, cap);
+        if (!ids) break;
+        session_list(&state->sessions, ids, cap, &total);
+        if ((total + 1) * (SESSION_ID_MAX + 3) < cap) break;
+        cap = (total + 64) * (SESSION_ID_MAX + 3);
+    }
+    size_t body_cap = ids ? strlen(ids) + 64 : 0;
+    char* body = ids ? arena_alloc(&client->arena, body_cap) : NULL;
+    if (!body) {
+        send_server_error(client);
+        return;
+    }
+    int len = snprintf(body, body_cap, "{\"count\":%zu,\"sessions\":[%s]}", total, ids);
+    send_response(client, "200 OK", "application/json", body, (size_t)len);
+}
+
+/*
+ * Route handlers. Each gets the match, whose parameters and query point
+ * into the request target, and reads any headers or body it cares about
+ * from the client's parsed request. Replies are queued on the client;
+ * scratch comes from its arena.
+ */
+typedef void (*RouteHandler)(ServerState* state, Client* client, const RouteMatch* match);
+
+typedef struct {
+    const char* pattern;
+    uint32_t methods;
+    RouteHandler handler;
+} Route;
+
+static void route_index_page(ServerState* state, Client* client, const RouteMatch* match) {
+    const char* html = "<html><body><h1>Fano Garden C Server</h1><p>Running on port 8080</p></body></html>";
+    send_response(client, "200 OK", "text/html", html, strlen(html));
+}
+
+static void route_server_info(ServerState* state, Client* client, const RouteMatch* match) {
+    char response[256];
+    CanonSnapshot* snap = canon_snapshot_acquire(&state->canon_source);
+    snprintf(response, sizeof(response),
+        "{\"server\":\"Fano Garden C Server\",\"port\":%d,\"chunks\":%zu,\"generation\":%lu}",
+        PORT, snap->store.count, (unsigned long)snap->generation);
+    canon_snapshot_release(snap);
+    send_json(client, response);
+}
+
+static void route_canon(ServerState* state, Client* client, const RouteMatch* match) {
+    handle_session_command(state, client, SESSION_DEFAULT, strlen(SESSION_DEFAULT), "");
+}
+
+/* seek and speed also take their argument as a POST body: POST /api/seek with "0.5" runs "seek?0.5". */
+static const char* command_with_body(Client* client, const char* command) {
+    const HttpRequest* req = &client->request;
+    if (req->body_len == 0 || (strcmp(command, "seek") != 0 && strcmp(command, "speed") != 0)) return command;
+    
+    size_t len = strlen(command);
+    char* full = arena_alloc(&client->arena, len + req->body_len + 2);
+    if (!full) return command;
+    memcpy(full, command, len);
+    full[len] = '?';
+    memcpy(full + len + 1, request_data(client) + req->body_off, req->body_len);
+    full[len + 1 + req->body_len] = '\0';
+    return full;
+}
+
+/* The unnamed control routes drive the default session: /api/seek?0.5 runs "seek?0.5". */
+static void route_control(ServerState* state, Client* client, const RouteMatch* match) {
+    const char* command = command_with_body(client, match->path + 5);
+    handle_session_command(state, client, SESSION_DEFAULT, strlen(SESSION_DEFAULT), command);
+}
+
+/* /api/session/ID for status, /api/session/ID/COMMAND[?arg] for control. */
+static void route_session(ServerState* state, Client* client, const RouteMatch* match) {
+    size_t id_len;
+    const char* id = route_param(match, "id", &id_len);
+    const char* command = route_param(match, "command", NULL);
+    handle_session_command(state, client, id, id_len, command ? command_with_body(client, command) : "");
+}
+
+static void route_sessions(ServerState* state, Client* client, const RouteMatch* match) {
+    send_session_list(state, client);
+}
+
+static void route_chunk(ServerState* state, Client* client, const RouteMatch* match) {
+    uint32_t index = (uint32_t)strtoul(route_param(match, "n", NULL), NULL, 10);
+    CanonSnapshot* snap = canon_snapshot_acquire(&state->canon_source);
+    if (index >= snap->store.count) {
+        canon_snapshot_release(snap);
+        send_not_found(client);
+        return;
+    }
+    const CanonStore* store = &snap->store;
+    uint8_t matrix[7];
+    canon_store_matrix(store, index, matrix);
+    
+    size_t record_len, article_len, id_len;
+    const char* record = canon_store_string(store, store->record[index], &record_len);
+    const char* article = canon_store_string(store, store->article[index], &article_len);
+    const char* id = canon_store_string(store, store->id[index], &id_len);
+    const char* event = canon_store_event_name(store, index);
+    
+    size_t cap = 512 + record_len + 6 * (article_len + id_len + strlen(event));
+    char* body = arena_alloc(&client->arena, cap);
+    if (!body) {
+        canon_snapshot_release(snap);
+        send_server_error(client);
+        return;
+    }
+    size_t n = (size_t)snprintf(body, cap,
+        "{\"index\":%u,\"matrix\":[%d,%d,%d,%d,%d,%d,%d],"
+        "\"angle\":%.2f,\"seed\":%u,\"timestamp\":%lu,\"event\":\"",
+        index,
+        matrix[0], matrix[1], matrix[2],
+        matrix[3], matrix[4], matrix[5], matrix[6],
+        canon_store_angle(store, index), store->seed[index],
+        (unsigned long)store->timestamp[index]);
+    n += json_escape(body + n, cap - n, event, strlen(event));
+    n += (size_t)snprintf(body + n, cap - n, "\",\"article\":\"");
+    n += json_escape(body + n, cap - n, article, article_len);
+    n += (size_t)snprintf(body + n, cap - n, "\",\"id\":\"");
+    n += json_escape(body + n, cap - n, id, id_len);
+    n += (size_t)snprintf(body + n, cap - n, "\",\"chapter\":%u,\"verse\":%u,\"record\":%.*s}",
+                          store->chapter[index], store->verse[index],
+                          record_len ? (int)record_len : 4, record_len ? record : "null");
+    canon_snapshot_release(snap);
+    send_response(client, "200 OK", "application/json", body, n);
+}
+
+/*
+ * /api/chunks?from=A&to=B streams rows [A, B) as NDJSON, or as fano-bin
+ * messages with format=bin, using chunked transfer encoding. fields=
+ * picks the NDJSON members (matrix,angle,seed,...; all by default). Rows
+ * are encoded from the snapshot as the socket drains, see export_fill, so
+ * a whole canon costs one output window of memory.
+ */
+static void route_chunks(ServerState* state, Client* client, const RouteMatch* match) {
+    size_t len;
+    uint32_t fields = 0;
+    const char* value = route_query(match, "fields", &len);
+    if (value && len > 0 && !(fields = canon_export_fields(value, len))) {
+        send_response(client, "400 Bad Request", "text/plain", "Unknown field", 13);
+        return;
+    }
+    CanonExportFormat format = CANON_EXPORT_NDJSON;
+    value = route_query(match, "format", &len);
+    if (value && len == 3 && memcmp(value, "bin", 3) == 0) {
+        format = CANON_EXPORT_BIN;
+    } else if (value && !(len == 6 && memcmp(value, "ndjson", 6) == 0)) {
+        send_response(client, "400 Bad Request", "text/plain", "Unknown format", 14);
+        return;
+    }
+    const char* from = route_query(match, "from", NULL);
+    const char* to = route_query(match, "to", NULL);
+    
+    /* HTTP/1.0 has no chunked encoding; the body ends with the connection instead. */
+    client->export_chunked = client->request.minor_version >= 1;
+    if (!client->export_chunked) client->keep_alive = 0;
+    char head[512];
+    int head_len = snprintf(head, sizeof(head),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: %s\r\n"
+        "%s"
+        "Cache-Control: no-cache\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "%s"
+        "\r\n",
+        format == CANON_EXPORT_BIN ? "application/octet-stream" : "application/x-ndjson",
+        client->export_chunked ? "Transfer-Encoding: chunked\r\n" : "", connection_header(client));
+    outq_push_copy(&client->out, head, head_len);
+    if (client->head_only) return;
+    
+    CanonSnapshot* snap = canon_snapshot_acquire(&state->canon_source);
+    canon_export_begin(&client->export, &snap->store, from ? strtoull(from, NULL, 10) : 0,
+                       to ? strtoull(to, NULL, 10) : SIZE_MAX, fields, format);
+    client->export_snap = snap;
+}
+
+static void route_fano(ServerState* state, Client* client, const RouteMatch* match) {
+    char response[256];
+    unsigned long point = strtoul(route_param(match, "p", NULL), NULL, 10);
+    if (point >= 8) {
+        send_not_found(client);
+        return;
+    }
+    snprintf(response, sizeof(response),
+        "{\"point\":%lu,\"name\":\"%s\",\"hue\":%d,\"ratio\":%.4f}",
+        point + 1, FANO_NAMES[point], FANO_HUES[point],
+        (float)FANO_HUES[point] / 360.0f);
+    send_json(client, response);
+}
+
+static void route_workers(ServerState* state, Client* client, const RouteMatch* match) {
+    /* One stats line per worker on top of the envelope. */
+    size_t cap = 128 + (size_t)state->worker_count * 160;
+    char* response = arena_alloc(&client->arena, cap);
+    if (!response) {
+        send_server_error(client);
+        return;
+    }
+    int len = snprintf(response, cap, "{\"workers\":[");
+    for (int i = 0; i < state->worker_count; i++) {
+        Worker* w = &state->workers[i];
+        len += snprintf(response + len, cap - len,
+            "%s{\"id\":%d,\"accepted\":%lu,\"requests\":%lu,\"closed\":%lu,\"active\":%lu,\"streams\":%lu}",
+            i ? "," : "", w->id,
+            (unsigned long)stat_get(&w->stats.accepted),
+            (unsigned long)stat_get(&w->stats.requests),
+            (unsigned long)stat_get(&w->stats.closed),
+            (unsigned long)stat_get(&w->stats.active),
+            (unsigned long)stat_get(&w->stats.streams));
+    }
+    snprintf(response + len, cap - len, "],\"stream_drops\":%lu}",
+             (unsigned long)stat_get(&state->sse.dropped));
+    send_json(client, response);
+}
+
+static void route_clock(ServerState* state, Client* client, const RouteMatch* match) {
+    char response[512];
+    PlayerClock* clock = &state->clock;
+    uint64_t frames = stat_get(&clock->frames);
+    snprintf(response, sizeof(response),
+        "{\"frame_ms\":%d,\"tick_ms\":%d,\"frames\":%lu,\"overruns\":%lu,"
+        "\"jitter_avg_us\":%.1f,\"jitter_max_us\":%.1f,\"jitter_last_us\":%.1f}",
+        CANON_FRAME_MS, CANON_TICK_MS, (unsigned long)frames,
+        (unsigned long)stat_get(&clock->overruns),
+        frames ? stat_get(&clock->jitter_total_ns) / 1000.0 / frames : 0.0,
+        stat_get(&clock->jitter_max_ns) / 1000.0,
+        stat_get(&clock->jitter_last_ns) / 1000.0);
+    send_json(client, response);
+}
+
+static void route_ws(ServerState* state, Client* client, const RouteMatch* match) {
+    char ws_info[512];
+    snprintf(ws_info, sizeof(ws_info),
+        "{\"ws_port\":%d,\"protocol\":\"fano-protocol\",\"protocols\":[\"fano-protocol\",\"fano-bin\"],"
+        "\"clients\":%d,\"coalesced\":%lu,\"dropped\":%lu,\"batched\":%lu}",
+        WS_PORT, atomic_load(&state->ws.client_count),
+        (unsigned long)atomic_load(&state->ws.coalesced),
+        (unsigned long)atomic_load(&state->ws.dropped),
+        (unsigned long)atomic_load(&state->ws.batched));
+    send_json(client, ws_info);
+}
+
+/* Pool sizing data; POOL_DEBUG builds add live counts and misuse counters. */
+static void route_metrics(ServerState* state, Client* client, const RouteMatch* match) {
+    char* metrics = arena_alloc(&client->arena, METRICS_RESPONSE_MAX);
+    size_t metrics_len = metrics ? pool_metrics_json(metrics, METRICS_RESPONSE_MAX) : 0;
+    if (metrics_len) send_response(client, "200 OK", "application/json", metrics, metrics_len);
+    else send_server_error(client);
+}
+
+static void route_models(ServerState* state, Client* client, const RouteMatch* match) {
+    if (serve_file(client, "storage/models/index.json", "application/json", NULL) < 0) {
+        send_json(client, "{\"samples\":[],\"error\":\"No models found\"}");
+    }
+}
+
+static void route_assets_index(ServerState* state, Client* client, const RouteMatch* match) {
+    if (serve_file(client, "storage/canon-assets.ndjson", "application/x-ndjson", NULL) < 0) {
+        send_not_found(client);
+    }
+}
+
+/*
+ * Turns the connection into an event stream for one session
+ * (?session=ID, default session otherwise), optionally resuming with
+ * Last-Event-ID or ?from=N, ?chunk=N, ?compact=1. The reactor takes it
+ * over once the request has been handled, see stream_attach.
+ */
+static void route_events(ServerState* state, Client* client, const RouteMatch* match) {
+    size_t session_len = strlen(SESSION_DEFAULT);
+    const char* session = route_query(match, "session", &session_len);
+    if (!session) {
+        session = SESSION_DEFAULT;
+        session_len = strlen(SESSION_DEFAULT);
+    } else if (!session_id_valid(session, session_len)) {
+        send_not_found(client);
+        return;
+    }
+    
+    char head[512];
+    size_t head_len = sse_preamble(head, sizeof(head));
+    outq_push_copy(&client->out, head, head_len);
+    memcpy(client->stream_session, session, session_len);
+    client->stream_session[session_len] = '\0';
+    memset(&client->stream_request, 0, sizeof(client->stream_request));
+    broadcast_resume_parse(match->query, &client->stream_request);
+    size_t last_len = 0;
+    const char* last = request_header(client, "Last-Event-ID", &last_len);
+    if (sse_last_event_id(last, last_len, match->query, &client->stream_request.from)) {
+        client->stream_request.resuming = 1;
+    }
+    client->streaming = 1;
+    client->keep_alive = 1;
+}
+
+#define ROUTE_READ (ROUTE_GET | ROUTE_HEAD)
+#define ROUTE_WRITE (ROUTE_GET | ROUTE_POST)
+
+/*
+ * A new endpoint is one row here. Static assets join the same router at
+ * startup. Reads also answer HEAD; controls have side effects, so they
+ * take GET or POST but not HEAD.
+ */
+static const Route ROUTES[] = {
+    {"/", ROUTE_READ, route_index_page},
+    {"/index.html", ROUTE_READ, route_index_page},
+    {"/api", ROUTE_READ, route_server_info},
+    {"/api/canon", ROUTE_READ, route_canon},
+    {"/api/canon.json", ROUTE_READ, route_canon},
+    {"/api/play", ROUTE_WRITE, route_control},
+    {"/api/pause", ROUTE_WRITE, route_control},
+    {"/api/stop", ROUTE_WRITE, route_control},
+    {"/api/seek", ROUTE_WRITE, route_control},
+    {"/api/speed", ROUTE_WRITE, route_control},
+    {"/api/session/:id", ROUTE_WRITE, route_session},
+    {"/api/session/:id/:command", ROUTE_WRITE, route_session},
+    {"/api/sessions", ROUTE_READ, route_sessions},
+    {"/api/chunk/:n", ROUTE_READ, route_chunk},
+    {"/api/chunks", ROUTE_READ, route_chunks},
+    {"/api/fano/:p", ROUTE_READ, route_fano},
+    {"/api/workers", ROUTE_READ, route_workers},
+    {"/api/clock", ROUTE_READ, route_clock},
+    {"/api/ws", ROUTE_READ, route_ws},
+    {"/api/metrics", ROUTE_READ, route_metrics},
+    {"/api/models", ROUTE_READ, route_models},
+    {"/api/models.json", ROUTE_READ, route_models},
+    {"/api/assets", ROUTE_READ, route_assets_index},
+    {"/api/assets.ndjson", ROUTE_READ, route_assets_index},
+    {"/api/events", ROUTE_GET, route_events},
+};
+
+#define ROUTE_COUNT ((int)(sizeof(ROUTES) / sizeof(ROUTES[0])))
+
+/* Route ids past ROUTE_COUNT are static assets, by asset cache index. */
+static int routes_init(ServerState* state) {
+    if (router_init(&state->router) < 0) return -1;
+    for (int i = 0; i < ROUTE_COUNT; i++) {
+        if (router_add(&state->router, ROUTES[i].pattern, ROUTES[i].methods, i) < 0) return -1;
+    }
+    for (size_t i = 0; i < state->assets.count; i++) {
+        const AssetRoute* route = state->assets.entries[i].route;
+        for (int a = 0; a < ASSET_MAX_ALIASES && route->paths[a]; a++) {
+            if (router_add(&state->router, route->paths[a], ROUTE_READ, ROUTE_COUNT + (int)i) < 0) return -1;
         }
     }
-    else {
-        send_not_found(client->fd);
+    return 0;
+}
+
+static void serve_asset(ServerState* state, Client* client, int asset) {
+    AssetBlob* blob = asset_cache_acquire(&state->assets, asset);
+    const AssetRoute* route = state->assets.entries[asset].route;
+    size_t tags_len;
+    const char* tags = request_header(client, "If-None-Match", &tags_len);
+    if (blob && tags && http_etag_match(tags, tags_len, blob->etag)) {
+        send_not_modified(client, blob->etag);
+    } else if (blob && blob->streamed) {
+        if (serve_file(client, route->file, route->content_type, blob->etag) < 0) send_not_found(client);
+    } else if (blob) {
+        send_asset(client, blob);
+    } else {
+        send_not_found(client);
     }
+    asset_blob_release(blob);
 }
 
 static void handle_client_message(ServerState* state, Client* client) {
-    char* data = client->buffer;
-    size_t len = client->buffer_len;
+    const HttpRequest* req = &client->request;
+    char* data = request_data(client);
+    uint32_t method = router_method(data + req->method.off, req->method.len);
+    client->head_only = method == ROUTE_HEAD;
+    if (!method) {
+        send_response(client, "501 Not Implemented", "text/plain", "Not Implemented", 15);
+        return;
+    }
     
-    if (len < 4) return;
+    /* The space after the target becomes its terminator; the slices still describe the line. */
+    data[req->target.off + req->target.len] = '\0';
+    RouteMatch match;
+    int found = router_match(&state->router, data + req->target.off, method, &match);
+    if (found == ROUTE_NOT_FOUND) {
+        send_not_found(client);
+    } else if (found == ROUTE_BAD_METHOD) {
+        send_response(client, "405 Method Not Allowed", "text/plain", "Method Not Allowed", 18);
+    } else if (match.route < ROUTE_COUNT) {
+        ROUTES[match.route].handler(state, client, &match);
+    } else {
+        serve_asset(state, client, match.route - ROUTE_COUNT);
+    }
+}
+
+static void clock_record(PlayerClock* clock, uint64_t jitter_ns, uint64_t expirations) {
+    stat_add(&clock->frames, 1);
+    if (expirations > 1) stat_add(&clock->overruns, (int64_t)(expirations - 1));
+    stat_add(&clock->jitter_total_ns, (int64_t)jitter_ns);
+    atomic_store_explicit(&clock->jitter_last_ns, jitter_ns, memory_order_relaxed);
+    if (jitter_ns > stat_get(&clock->jitter_max_ns)) {
+        atomic_store_explicit(&clock->jitter_max_ns, jitter_ns, memory_order_relaxed);
+    }
+}
+
+static void broadcast_session_chunk(PlaybackSession* session, const CanonStore* store,
+                                    uint32_t index, void* arg) {
+    ServerState* state = (ServerState*)arg;
     
-    if (strncmp(data, "GET ", 4) == 0) {
-        char* path_start = data + 4;
-        char* path_end = strchr(path_start, ' ');
-        if (!path_end) return;
-        
-        char path[256];
-        size_t path_len = path_end - path_start;
-        if (path_len >= sizeof(path)) path_len = sizeof(path) - 1;
-        strncpy(path, path_start, path_len);
-        path[path_len] = '\0';
-        
-        if (strncmp(path, "/api/", 5) == 0) {
-            handle_api_request(state, client, path);
-        }
-        else if (strcmp(path, "/composer") == 0 || strcmp(path, "/composer.html") == 0) {
-            FILE* hf = fopen("public/composer.html", "r");
-            if (hf) {
-                fseek(hf, 0, SEEK_END);
-                long hsize = ftell(hf);
-                fseek(hf, 0, SEEK_SET);
-                char* html = malloc(hsize + 1);
-                fread(html, 1, hsize, hf);
-                html[hsize] = '\0';
-                fclose(hf);
-                char header[256];
-                int header_len = snprintf(header, sizeof(header),
-                    "HTTP/1.1 200 OK\r\n"
-                    "Content-Type: text/html\r\n"
-                    "Content-Length: %ld\r\n"
-                    "Access-Control-Allow-Origin: *\r\n"
-                    "\r\n", hsize);
-                write(client->fd, header, header_len);
-                write(client->fd, html, hsize);
-                free(html);
-            } else {
-                send_not_found(client->fd);
-            }
-        }
-        else if (strcmp(path, "/composer.js") == 0) {
-            FILE* jf = fopen("public/composer.js", "r");
-            if (jf) {
-                fseek(jf, 0, SEEK_END);
-                long jsize = ftell(jf);
-                fseek(jf, 0, SEEK_SET);
-                char* js = malloc(jsize + 1);
-                fread(js, 1, jsize, jf);
-                js[jsize] = '\0';
-                fclose(jf);
-                char header[256];
-                int header_len = snprintf(header, sizeof(header),
-                    "HTTP/1.1 200 OK\r\n"
-                    "Content-Type: application/javascript\r\n"
-                    "Content-Length: %ld\r\n"
-                    "Access-Control-Allow-Origin: *\r\n"
-                    "\r\n", jsize);
-                write(client->fd, header, header_len);
-                write(client->fd, js, jsize);
-                free(js);
-            } else {
-                send_not_found(client->fd);
-            }
-        }
-        else if (strcmp(path, "/composer.css") == 0) {
-            FILE* cf = fopen("public/composer.css", "r");
-            if (cf) {
-                fseek(cf, 0, SEEK_END);
-                long csize = ftell(cf);
-                fseek(cf, 0, SEEK_SET);
-                char* css = malloc(csize + 1);
-                fread(css, 1, csize, cf);
-                css[csize] = '\0';
-                fclose(cf);
-                char header[256];
-                int header_len = snprintf(header, sizeof(header),
-                    "HTTP/1.1 200 OK\r\n"
-                    "Content-Type: text/css\r\n"
-                    "Content-Length: %ld\r\n"
-                    "Access-Control-Allow-Origin: *\r\n"
-                    "\r\n", csize);
-                write(client->fd, header, header_len);
-                write(client->fd, css, csize);
-                free(css);
-            } else {
-                send_not_found(client->fd);
-            }
-        }
-        else if (strcmp(path, "/pipe.js") == 0) {
-            FILE* pf = fopen("public/pipe.js", "r");
-            if (pf) {
-                fseek(pf, 0, SEEK_END);
-                long psize = ftell(pf);
-                fseek(pf, 0, SEEK_SET);
-                char* js = malloc(psize + 1);
-                fread(js, 1, psize, pf);
-                js[psize] = '\0';
-                fclose(pf);
-                char header[256];
-                int header_len = snprintf(header, sizeof(header),
-                    "HTTP/1.1 200 OK\r\n"
-                    "Content-Type: application/javascript\r\n"
-                    "Content-Length: %ld\r\n"
-                    "Access-Control-Allow-Origin: *\r\n"
-                    "\r\n", psize);
-                write(client->fd, header, header_len);
-                write(client->fd, js, psize);
-                free(js);
-            } else {
-                send_not_found(client->fd);
-            }
-        }
-        else if (strcmp(path, "/fano-editor.js") == 0) {
-            FILE* ef = fopen("public/fano-editor.js", "r");
-            if (ef) {
-                fseek(ef, 0, SEEK_END);
-                long esize = ftell(ef);
-                fseek(ef, 0, SEEK_SET);
-                char* js = malloc(esize + 1);
-                fread(js, 1, esize, ef);
-                js[esize] = '\0';
-                fclose(ef);
-                char header[256];
-                int header_len = snprintf(header, sizeof(header),
-                    "HTTP/1.1 200 OK\r\n"
-                    "Content-Type: application/javascript\r\n"
-                    "Content-Length: %ld\r\n"
-                    "Access-Control-Allow-Origin: *\r\n"
-                    "\r\n", esize);
-                write(client->fd, header, header_len);
-                write(client->fd, js, esize);
-                free(js);
-            } else {
-                send_not_found(client->fd);
-            }
-        }
-        else if (strcmp(path, "/firmware.html") == 0 || strcmp(path, "/fano-minimal.html") == 0) {
-            FILE* ff = fopen("public/fano-minimal.html", "r");
-            if (ff) {
-                fseek(ff, 0, SEEK_END);
-                long fsize = ftell(ff);
-                fseek(ff, 0, SEEK_SET);
-                char* html = malloc(fsize + 1);
-                fread(html, 1, fsize, ff);
-                html[fsize] = '\0';
-                fclose(ff);
-                char header[256];
-                int header_len = snprintf(header, sizeof(header),
-                    "HTTP/1.1 200 OK\r\n"
-                    "Content-Type: text/html\r\n"
-                    "Content-Length: %ld\r\n"
-                    "Access-Control-Allow-Origin: *\r\n"
-                    "\r\n", fsize);
-                write(client->fd, header, header_len);
-                write(client->fd, html, fsize);
-                free(html);
-            } else {
-                send_not_found(client->fd);
-            }
-        }
-        else if (strcmp(path, "/interplanetary") == 0 || strcmp(path, "/demo") == 0) {
-            FILE* df = fopen("public/interplanetary-demo/player.html", "r");
-            if (df) {
-                fseek(df, 0, SEEK_END);
-                long dsize = ftell(df);
-                fseek(df, 0, SEEK_SET);
-                char* html = malloc(dsize + 1);
-                fread(html, 1, dsize, df);
-                html[dsize] = '\0';
-                fclose(df);
-                char header[256];
-                int header_len = snprintf(header, sizeof(header),
-                    "HTTP/1.1 200 OK\r\n"
-                    "Content-Type: text/html\r\n"
-                    "Content-Length: %ld\r\n"
-                    "Access-Control-Allow-Origin: *\r\n"
-                    "\r\n", dsize);
-                write(client->fd, header, header_len);
-                write(client->fd, html, dsize);
-                free(html);
-            } else {
-                send_not_found(client->fd);
-            }
-        }
-        else if (strcmp(path, "/") == 0 || strcmp(path, "/index.html") == 0) {
-            char* html = "<html><body><h1>Fano Garden C Server</h1><p>Running on port 8080</p></body></html>";
-            send_response(client->fd, "200 OK", "text/html", html, strlen(html));
-        }
-        else {
-            send_not_found(client->fd);
-        }
+    /* Subscribers that follow single Fano points only hear about the ones that changed. */
+    uint16_t matrix = store->matrix[index];
+    uint16_t diff = session->shown ? (uint16_t)(matrix ^ session->shown_matrix) : 0x3FFF;
+    uint8_t changed = 0;
+    for (int point = 0; point < 7; point++) {
+        if (diff & (3u << (point * 2))) changed |= (uint8_t)(1u << point);
     }
+    session->shown_matrix = matrix;
+    session->shown = 1;
+    
+    /* Encoded once here and logged; every transport and client shares the same frames. */
+    BroadcastFrame* canon = broadcast_canon(session->id, store, index, changed);
+    BroadcastFrame* status = broadcast_status(session->id, store->count, index,
+                                              atomic_load(&session->playing), session->applied_speed);
+    broadcast_ring_publish(&state->events, canon);
+    broadcast_ring_publish(&state->events, status);
+    ws_wake(&state->ws);
+    sse_wake(&state->sse);
+    broadcast_release(canon);
+    broadcast_release(status);
 }
 
+/*
+ * Wakes every CANON_FRAME_MS on an absolute CLOCK_MONOTONIC timerfd, so
+ * frames never drift, and hands the frame to the session timer wheel. Each
+ * session keeps a fractional chunk position advanced by measured elapsed
+ * time times its speed; a chunk lasts CANON_TICK_MS at 1x.
+ */
 static void* canon_player_thread(void* arg) {
     ServerState* state = (ServerState*)arg;
-    uint64_t last_tick = 0;
-    uint32_t last_index = 0;
+    CanonSnapshot* pinned = NULL;
+    
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (timer_fd < 0) {
+        perror("timerfd_create");
+        return NULL;
+    }
+    const uint64_t frame_ns = (uint64_t)CANON_FRAME_MS * 1000000ULL;
+    uint64_t deadline = monotonic_ns() + frame_ns;
+    struct itimerspec spec = {
+        .it_interval = { .tv_sec = 0, .tv_nsec = (long)frame_ns },
+        .it_value = { .tv_sec = (time_t)(deadline / 1000000000ULL), .tv_nsec = (long)(deadline % 1000000000ULL) }
+    };
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0) {
+        perror("timerfd_settime");
+        close(timer_fd);
+        return NULL;
+    }
+    deadline -= frame_ns;
     
     while (state->running) {
-        usleep(10000);
-        
-        uint64_t now = (uint64_t)(time(NULL)) * 1000;
-        if (now - last_tick < CANON_TICK_MS) continue;
-        
-        pthread_mutex_lock(&state->canon_mutex);
-        
-        if (state->canon.playing && state->canon.count > 0) {
-            uint32_t steps = (uint32_t)((now - last_tick) / (CANON_TICK_MS / state->canon.speed));
-            if (steps > 0) {
-                state->canon.current_index += steps;
-                if (state->canon.current_index >= state->canon.count) {
-                    state->canon.current_index = 0;
-                }
-                
-                if (state->canon.current_index != last_index) {
-                    CanonChunk* chunk = &state->canon.chunks[state->canon.current_index];
-                    ws_broadcast_canon(&state->ws, state->canon.current_index, chunk->matrix, chunk->angle);
-                    float progress = (float)state->canon.current_index / state->canon.count;
-                    ws_broadcast_status(&state->ws, state->canon.count, state->canon.current_index, state->canon.playing, state->canon.speed);
-                    last_index = state->canon.current_index;
-                }
-            }
+        uint64_t expirations;
+        if (read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            if (errno == EINTR) continue;
+            perror("timerfd read");
+            break;
         }
+        uint64_t now = monotonic_ns();
+        deadline += expirations * frame_ns;
+        clock_record(&state->clock, now > deadline ? now - deadline : 0, expirations);
         
-        last_tick = now;
-        pthread_mutex_unlock(&state->canon_mutex);
+        CanonSnapshot* latest = canon_snapshot_acquire(&state->canon_source);
+        if (latest != pinned) {
+            /* New content: every session carries on from the same moment. */
+            session_table_rebase(&state->sessions, pinned, latest);
+            canon_snapshot_release(pinned);
+            pinned = latest;
+        } else {
+            canon_snapshot_release(latest);
+        }
+        session_table_advance(&state->sessions, pinned, expirations, now);
     }
     
+    canon_snapshot_release(pinned);
+    close(timer_fd);
     return NULL;
 }
 
-static void handle_client_close(ServerState* state, int client_fd) {
+/*
+ * Output is in flight while anything is queued or a /api/chunks export
+ * still has rows to encode: export_fill only tops the queue up as it
+ * drains, so a large range can sit between batches with the queue briefly
+ * empty and must not be mistaken for an idle keep-alive connection.
+ */
+static int client_sending(const Client* client) {
+    return outq_pending(&client->out) || client->export_snap != NULL;
+}
+
+static void deadline_unlink(Client* client) {
+    ClientList* list = client->deadline;
+    if (!list) return;
+    if (client->deadline_prev) client->deadline_prev->deadline_next = client->deadline_next;
+    else list->head = client->deadline_next;
+    if (client->deadline_next) client->deadline_next->deadline_prev = client->deadline_prev;
+    else list->tail = client->deadline_prev;
+    client->deadline_prev = client->deadline_next = NULL;
+    client->deadline = NULL;
+}
+
+/*
+ * Restarts the connection's deadline. With nothing to send it waits on the
+ * idle list for KEEPALIVE_TIMEOUT_S; while output is queued or an export
+ * is still producing it waits on the sending list instead, touched again
+ * each time the socket drains, so a slow reader is only dropped once it
+ * stops taking bytes for SEND_TIMEOUT_S. Both lists are kept in
+ * last_active order so expiry only looks at their heads.
+ */
+static void deadline_touch(Worker* worker, Client* client) {
+    if (client->streaming) return;
+    ClientList* list = client_sending(client) ? &worker->sending : &worker->idle;
+    client->last_active = monotonic_seconds();
+    if (list->tail == client) return;
+    deadline_unlink(client);
+    client->deadline = list;
+    client->deadline_prev = list->tail;
+    if (list->tail) list->tail->deadline_next = client;
+    else list->head = client;
+    list->tail = client;
+}
+
+static void stream_detach(Worker* worker, Client* client) {
+    if (client->stream_prev) client->stream_prev->stream_next = client->stream_next;
+    else worker->streams = client->stream_next;
+    if (client->stream_next) client->stream_next->stream_prev = client->stream_prev;
+    client->stream_prev = client->stream_next = NULL;
+    stat_add(&worker->stats.streams, -1);
+    stat_add(&worker->server->sse.clients, -1);
+}
+
+static void export_finish(Client* client) {
+    canon_snapshot_release(client->export_snap);
+    client->export_snap = NULL;
+}
+
+static void put_hex8(char* out, size_t value) {
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 7; i >= 0; i--) {
+        out[i] = hex[value & 15];
+        value >>= 4;
+    }
+}
+
+/*
+ * Encodes the next rows of a /api/chunks response straight into the output
+ * queue, one HTTP chunk per segment, until OUTPUT_HIGH_WATER bytes wait or
+ * the range is done; the reactor calls it again once they have drained.
+ * Returns 1 when it queued anything.
+ */
+static int export_fill(Client* client) {
+    CanonExport* export = &client->export;
+    size_t frame = client->export_chunked ? EXPORT_FRAME : 0;
+    size_t trailer = client->export_chunked ? 2 : 0;
+    int queued = 0;
+    while (client->out.bytes < OUTPUT_HIGH_WATER && !canon_export_done(export)) {
+        size_t avail;
+        char* out = outq_reserve(&client->out, frame + canon_export_bound(export) + trailer, &avail);
+        if (!out) {
+            /* Cut short; closing is how the client learns the body is incomplete. */
+            export_finish(client);
+            client->keep_alive = 0;
+            client->closing = 1;
+            return 1;
+        }
+        size_t n = canon_export_rows(export, out + frame, avail - frame - trailer);
+        if (client->export_chunked) {
+            put_hex8(out, n);
+            memcpy(out + 8, "\r\n", 2);
+            memcpy(out + frame + n, "\r\n", 2);
+        }
+        outq_commit(&client->out, frame + n + trailer);
+        queued = 1;
+    }
+    if (canon_export_done(export)) {
+        if (client->export_chunked) outq_push_copy(&client->out, "0\r\n\r\n", 5);
+        export_finish(client);
+        if (!client->keep_alive) client->closing = 1;
+        queued = 1;
+    }
+    return queued;
+}
+
+static void handle_client_close(Worker* worker, int client_fd) {
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, client_fd, NULL);
     close(client_fd);
-    epoll_ctl(state->epoll_fd, EPOLL_CTL_DEL, client_fd, NULL);
-    if (state->clients[client_fd]) {
-        free(state->clients[client_fd]);
-        state->clients[client_fd] = NULL;
+    Client* client = worker->clients[client_fd];
+    if (client) {
+        outq_clear(&client->out);
+        if (client->export_snap) export_finish(client);
+        if (client->streaming) stream_detach(worker, client);
+        else deadline_unlink(client);
+        arena_reset(&client->arena);
+        arena_class_free(client->buffer, client->buffer_cap);
+        pool_free(worker->server->client_pool, client);
+        worker->clients[client_fd] = NULL;
+        stat_add(&worker->stats.closed, 1);
+        stat_add(&worker->stats.active, -1);
+    }
+}
+
+/*
+ * Queues a frame on a stream by reference. A client that cannot keep up is
+ * cut off rather than buffered without bound; EventSource reconnects on
+ * its own and resumes from its Last-Event-ID.
+ */
+static void stream_queue(Client* client, BroadcastFrame* frame, uint64_t now) {
+    if (client->closing || strcmp(frame->session, client->stream_session) != 0) return;
+    if (client->out.bytes > OUTPUT_HIGH_WATER) {
+        client->closing = 1;
+        return;
+    }
+    broadcast_retain(frame);
+    outq_push_ref(&client->out, frame->sse, frame->sse_len, broadcast_release_owner, frame);
+    client->last_active = now;
+}
+
+static void stream_flush(Worker* worker, Client* client) {
+    if (client->closing) {
+        stat_add(&worker->server->sse.dropped, 1);
+        handle_client_close(worker, client->fd);
+        return;
+    }
+    if (outq_pending(&client->out) && outq_flush(&client->out, client->fd) < 0) {
+        handle_client_close(worker, client->fd);
+    }
+}
+
+/*
+ * Hands a connection that asked for /api/events over to the worker's
+ * stream list. It first gets either the events it missed, when it is
+ * resuming from a point still in the log, or its session's current state.
+ */
+static void stream_attach(Worker* worker, Client* client) {
+    SSEContext* sse = &worker->server->sse;
+    if (!worker->streams) worker->sse_seq = broadcast_ring_head(sse->log);
+    deadline_unlink(client);
+    client->stream_next = worker->streams;
+    if (worker->streams) worker->streams->stream_prev = client;
+    worker->streams = client;
+    stat_add(&worker->stats.streams, 1);
+    stat_add(&sse->clients, 1);
+    
+    uint64_t now = monotonic_seconds();
+    client->last_active = now;
+    BroadcastResume resume;
+    broadcast_resume_plan(sse->log, client->stream_session, worker->sse_seq, &client->stream_request, &resume);
+    for (int i = 0; i < resume.snapshot_count; i++) {
+        BroadcastFrame* frame = broadcast_ring_acquire(sse->log, resume.snapshot[i]);
+        if (!frame) continue;
+        stream_queue(client, frame, now);
+        broadcast_release(frame);
+    }
+    for (uint64_t seq = resume.read_seq; seq < worker->sse_seq; ) {
+        BroadcastFrame* frame = broadcast_ring_acquire(sse->log, ++seq);
+        if (!frame) continue;
+        stream_queue(client, frame, now);
+        broadcast_release(frame);
+    }
+}
+
+/* Woken by the player: queue every new frame on every stream, then flush once each. */
+static void stream_drain(Worker* worker) {
+    SSEContext* sse = &worker->server->sse;
+    sse_woken(sse, worker->sse_waker);
+    uint64_t head = broadcast_ring_head(sse->log);
+    if (head - worker->sse_seq > BROADCAST_RING_SIZE) worker->sse_seq = head - BROADCAST_RING_SIZE;
+    
+    uint64_t now = monotonic_seconds();
+    while (worker->sse_seq < head) {
+        BroadcastFrame* frame = broadcast_ring_acquire(sse->log, ++worker->sse_seq);
+        if (!frame) continue;
+        for (Client* client = worker->streams; client; client = client->stream_next) {
+            stream_queue(client, frame, now);
+        }
+        broadcast_release(frame);
+    }
+    
+    Client* client = worker->streams;
+    while (client) {
+        Client* next = client->stream_next;
+        stream_flush(worker, client);
+        client = next;
+    }
+}
+
+/* A comment line every SSE_HEARTBEAT_S keeps proxies from timing quiet streams out. */
+static void stream_heartbeat(Worker* worker) {
+    uint64_t now = monotonic_seconds();
+    if (now < worker->heartbeat_at) return;
+    worker->heartbeat_at = now + 1;
+    
+    Client* client = worker->streams;
+    while (client) {
+        Client* next = client->stream_next;
+        if (now - client->last_active >= SSE_HEARTBEAT_S) {
+            outq_push_ref(&client->out, ": heartbeat\n\n", 13, NULL, NULL);
+            client->last_active = now;
+            stream_flush(worker, client);
+        }
+        client = next;
+    }
+}
+
+static void expire_clients(Worker* worker) {
+    uint64_t now = monotonic_seconds();
+    while (worker->idle.head && now - worker->idle.head->last_active >= KEEPALIVE_TIMEOUT_S) {
+        handle_client_close(worker, worker->idle.head->fd);
+    }
+    while (worker->sending.head && now - worker->sending.head->last_active >= SEND_TIMEOUT_S) {
+        handle_client_close(worker, worker->sending.head->fd);
     }
 }
 
-static int add_client(ServerState* state, int client_fd) {
-    Client* client = calloc(1, sizeof(Client));
+static int add_client(Worker* worker, int client_fd) {
+    MemoryPool* pool = worker->server->client_pool;
+    Client* client = pool_alloc(pool);
     if (!client) return -1;
     
+    memset(client, 0, sizeof(Client));
+    client->buffer = arena_class_alloc(BUFFER_INITIAL, &client->buffer_cap);
+    if (!client->buffer) {
+        pool_free(pool, client);
+        return -1;
+    }
+    client->buffer[0] = '\0';
+    http_request_reset(&client->request);
     client->fd = client_fd;
-    client->last_active = time(NULL);
     
     int flags = fcntl(client_fd, F_GETFL, 0);
     fcntl(client_fd, F_SETFL, flags | O_NONBLOCK);
     
     struct epoll_event ev;
-    ev.events = EPOLLIN | EPOLLET;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
     ev.data.fd = client_fd;
     
-    if (epoll_ctl(state->epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
-        free(client);
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+        arena_class_free(client->buffer, client->buffer_cap);
+        pool_free(pool, client);
         return -1;
     }
     
-    state->clients[client_fd] = client;
+    worker->clients[client_fd] = client;
+    deadline_touch(worker, client);
+    stat_add(&worker->stats.accepted, 1);
+    stat_add(&worker->stats.active, 1);
     return 0;
 }
 
-static void signal_handler(int sig) {
-    (void)sig;
-    printf("\nShutting down...\n");
+/*
+ * Runs the complete requests sitting in the buffer in order, queueing their
+ * responses, then flushes them together. The parser picks up where the
+ * last read left it, so a request arriving in pieces is scanned once.
+ * Parsing pauses while more than OUTPUT_HIGH_WATER bytes wait on a slow
+ * reader, so only that connection stalls. Returns -1 once the connection
+ * has been closed.
+ */
+static int process_requests(Worker* worker, Client* client) {
+    while (1) {
+        int handled = client->export_snap ? export_fill(client) : 0;
+        while (!client->closing && !client->streaming && !client->export_snap &&
+               client->out.bytes < OUTPUT_HIGH_WATER &&
+               client->buffer_pos < client->buffer_len) {
+            HttpRequest* req = &client->request;
+            int parsed = http_parse(req, request_data(client), client->buffer_len - client->buffer_pos,
+                                    BUFFER_SIZE - 1);
+            if (parsed == HTTP_PARSE_MORE) {
+                /* The head is in and the client is holding its body back until told to go on. */
+                if (req->expect_continue && req->state != HTTP_STATE_HEAD) {
+                    outq_push_copy(&client->out, "HTTP/1.1 100 Continue\r\n\r\n", 25);
+                    req->expect_continue = 0;
+                    handled++;
+                }
+                break;
+            }
+            
+            stat_add(&worker->stats.requests, 1);
+            if (parsed == HTTP_PARSE_ERROR) {
+                /* Framing is lost, so nothing after this request can be trusted. */
+                client->keep_alive = 0;
+                client->closing = 1;
+                send_bad_request(client, req->status);
+                handled++;
+                break;
+            }
+            
+            client->keep_alive = req->keep_alive && client->requests_served + 1 < KEEPALIVE_MAX_REQUESTS;
+            handle_client_message(worker->server, client);
+            /* The response is queued; everything the handler built for it goes at once. */
+            arena_reset(&client->arena);
+            if (client->streaming) stream_attach(worker, client);
+            client->requests_served++;
+            client->buffer_pos += req->length;
+            http_request_reset(req);
+            /* A range export decides when the connection ends once it has sent everything. */
+            if (!client->keep_alive && !client->export_snap) client->closing = 1;
+            handled++;
+        }
+        
+        int flushed = outq_flush(&client->out, client->fd);
+        if (flushed < 0 || (flushed > 0 && client->closing)) {
+            handle_client_close(worker, client->fd);
+            return -1;
+        }
+        /* Stop when the socket is full or no complete request is left. */
+        if (flushed == 0 || handled == 0 || client->out.bytes > 0) break;
+    }
+    
+    if (client->buffer_pos > 0) {
+        size_t remaining = client->buffer_len - client->buffer_pos;
+        memmove(client->buffer, client->buffer + client->buffer_pos, remaining);
+        client->buffer_len = remaining;
+        client->buffer_pos = 0;
+        client->buffer[client->buffer_len] = '\0';
+    }
+    if (client->buffer_len == 0 && client->buffer_cap > BUFFER_INITIAL) {
+        size_t cap;
+        char* small = arena_class_alloc(BUFFER_INITIAL, &cap);
+        if (small) {
+            arena_class_free(client->buffer, client->buffer_cap);
+            client->buffer = small;
+            client->buffer_cap = cap;
+            client->buffer[0] = '\0';
+        }
+    }
+    /* Whatever is still queued now decides which deadline the connection waits on. */
+    deadline_touch(worker, client);
+    return 0;
 }
 
-int main(int argc, char** argv) {
-    (void)argc;
-    (void)argv;
-    
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
-    
-    ServerState state;
-    memset(&state, 0, sizeof(state));
-    pthread_mutex_init(&state.canon_mutex, NULL);
-    state.running = 1;
+/* Doubles the read buffer, up to BUFFER_SIZE. */
+static int client_buffer_grow(Client* client) {
+    if (client->buffer_cap >= BUFFER_SIZE) return -1;
+    size_t cap;
+    char* grown = arena_class_alloc(client->buffer_cap * 2, &cap);
+    if (!grown) return -1;
+    memcpy(grown, client->buffer, client->buffer_len + 1);
+    arena_class_free(client->buffer, client->buffer_cap);
+    client->buffer = grown;
+    client->buffer_cap = cap;
+    return 0;
+}
+
+/* Edge-triggered: handle what is buffered, then drain the socket until EAGAIN. */
+static void handle_client_readable(Worker* worker, Client* client) {
+    deadline_touch(worker, client);
     
-    if (load_canon(&state.canon, "../canon-manifest.ndjson") < 0) {
-        fprintf(stderr, "Failed to load canon, using empty state\n");
-        state.canon.capacity = 100;
-        state.canon.chunks = calloc(100, sizeof(CanonChunk));
+    while (1) {
+        if (process_requests(worker, client) < 0) return;
+        if (client->closing || client->out.bytes >= OUTPUT_HIGH_WATER) return;
+        if (client->buffer_len >= client->buffer_cap - 1 && client_buffer_grow(client) < 0) {
+            handle_client_close(worker, client->fd);
+            return;
+        }
+        
+        ssize_t count = read(client->fd, client->buffer + client->buffer_len,
+                             client->buffer_cap - client->buffer_len - 1);
+        if (count > 0) {
+            client->buffer_len += count;
+            client->buffer[client->buffer_len] = '\0';
+            continue;
+        }
+        if (count < 0 && errno == EINTR) continue;
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        
+        handle_client_close(worker, client->fd);
+        return;
     }
-    state.canon.speed = 1.0f;
-    
-    ws_init(&state.ws, WS_PORT);
-    printf("WebSocket server initialized on port %d\n", WS_PORT);
+}
+
+static void handle_client_writable(Worker* worker, Client* client) {
+    if (!client_sending(client)) return;
+    /* Edge-triggered EPOLLOUT means the peer took some bytes: progress. */
+    deadline_touch(worker, client);
     
-    pthread_t ws_thread;
-    pthread_create(&ws_thread, NULL, ws_service_thread, &state.ws);
+    int flushed = outq_flush(&client->out, client->fd);
+    if (flushed == 0) return;
+    if (flushed < 0 || client->closing) {
+        handle_client_close(worker, client->fd);
+        return;
+    }
+    /* Output drained: pick up pipelined requests and unread input. */
+    handle_client_readable(worker, client);
+}
+
+static int worker_init(Worker* worker, ServerState* state, int id) {
+    worker->id = id;
+    worker->server = state;
+    worker->clients = calloc(MAX_CLIENTS, sizeof(Client*));
+    if (!worker->clients) return -1;
     
-    state.server_fd = create_server_socket(PORT);
-    if (state.server_fd < 0) {
-        fprintf(stderr, "Failed to create server socket\n");
-        return 1;
+    worker->server_fd = create_server_socket(PORT);
+    if (worker->server_fd < 0) {
+        fprintf(stderr, "Worker %d: failed to create server socket\n", id);
+        return -1;
     }
     
-    state.epoll_fd = epoll_create1(0);
-    if (state.epoll_fd < 0) {
-        fprintf(stderr, "Failed to create epoll\n");
-        return 1;
+    worker->epoll_fd = epoll_create1(0);
+    if (worker->epoll_fd < 0) {
+        fprintf(stderr, "Worker %d: failed to create epoll\n", id);
+        return -1;
     }
     
     struct epoll_event ev;
     ev.events = EPOLLIN;
-    ev.data.fd = state.server_fd;
-    epoll_ctl(state.epoll_fd, EPOLL_CTL_ADD, state.server_fd, &ev);
-    
-    pthread_t player_thread;
-    pthread_create(&player_thread, NULL, canon_player_thread, &state);
-    
-    printf("Fano C Server running on port %d\n", PORT);
-    printf("Loaded %zu canon chunks\n", state.canon.count);
-    printf("API endpoints:\n");
-    printf("  GET /api/canon       - Get canon state\n");
-    printf("  GET /api/play       - Start playback\n");
-    printf("  GET /api/pause      - Pause playback\n");
-    printf("  GET /api/stop       - Stop and reset\n");
-    printf("  GET /api/seek?0.5   - Seek to position (0-1)\n");
-    printf("  GET /api/speed?1.5  - Set playback speed\n");
-    printf("  GET /api/chunk/N    - Get chunk N\n");
-    printf("  GET /api/fano/N     - Get Fano point N info\n");
+    ev.data.fd = worker->server_fd;
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->server_fd, &ev);
     
-    struct epoll_event events[MAX_EVENTS];
+    /* The player pokes this when there are new events for the streams. */
+    worker->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (worker->event_fd < 0) {
+        fprintf(stderr, "Worker %d: failed to create eventfd\n", id);
+        return -1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.fd = worker->event_fd;
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->event_fd, &ev);
+    worker->sse_waker = sse_add_waker(&state->sse, worker->event_fd);
+    return 0;
+}
+
+static void worker_destroy(Worker* worker) {
+    if (worker->clients) {
+        for (int fd = 0; fd < MAX_CLIENTS; fd++) {
+            if (worker->clients[fd]) handle_client_close(worker, fd);
+        }
+        free(worker->clients);
+        worker->clients = NULL;
+    }
+    if (worker->server_fd > 0) close(worker->server_fd);
+    if (worker->event_fd > 0) close(worker->event_fd);
+    if (worker->epoll_fd > 0) close(worker->epoll_fd);
+}
+
+static void* worker_thread(void* arg) {
+    Worker* worker = (Worker*)arg;
+    ServerState* state = worker->server;
+    struct epoll_event* events = malloc(sizeof(struct epoll_event) * MAX_EVENTS);
+    if (!events) return NULL;
     
-    while (state.running) {
-        int nfds = epoll_wait(state.epoll_fd, events, MAX_EVENTS, 1000);
+    while (state->running) {
+        int nfds = epoll_wait(worker->epoll_fd, events, MAX_EVENTS, 1000);
         if (nfds < 0) {
             if (errno == EINTR) continue;
             break;
         }
         
         for (int i = 0; i < nfds; i++) {
-            if (events[i].data.fd == state.server_fd) {
+            if (events[i].data.fd == worker->server_fd) {
                 while (1) {
                     struct sockaddr_in client_addr;
                     socklen_t client_len = sizeof(client_addr);
-                    int client_fd = accept(state.server_fd, (struct sockaddr*)&client_addr, &client_len);
+                    int client_fd = accept(worker->server_fd, (struct sockaddr*)&client_addr, &client_len);
                     
                     if (client_fd < 0) break;
                     if (client_fd >= MAX_CLIENTS) {
@@ -687,45 +1400,174 @@ int main(int argc, char** argv) {
                         continue;
                     }
                     
-                    add_client(&state, client_fd);
+                    add_client(worker, client_fd);
                 }
             }
+            else if (events[i].data.fd == worker->event_fd) {
+                stream_drain(worker);
+            }
             else {
                 int client_fd = events[i].data.fd;
-                Client* client = state.clients[client_fd];
+                Client* client = worker->clients[client_fd];
                 
                 if (!client) continue;
                 
-                ssize_t count = read(client_fd, client->buffer + client->buffer_len,
-                                     BUFFER_SIZE - client->buffer_len - 1);
-                
-                if (count <= 0) {
-                    handle_client_close(&state, client_fd);
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    handle_client_close(worker, client_fd);
                     continue;
                 }
-                
-                client->buffer_len += count;
-                client->buffer[client->buffer_len] = '\0';
-                
-                char* end = strstr(client->buffer, "\r\n\r\n");
-                if (end) {
-                    *end = '\0';
-                    handle_client_message(&state, client);
-                    handle_client_close(&state, client_fd);
+                if (events[i].events & EPOLLOUT) {
+                    handle_client_writable(worker, client);
+                    if (worker->clients[client_fd] != client) continue;
+                }
+                if (events[i].events & EPOLLIN) {
+                    handle_client_readable(worker, client);
                 }
-                
-                client->last_active = time(NULL);
             }
         }
+        
+        expire_clients(worker);
+        stream_heartbeat(worker);
+    }
+    
+    free(events);
+    return NULL;
+}
+
+static int parse_worker_count(int argc, char** argv) {
+    const char* value = getenv("FANO_WORKERS");
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "--workers") == 0 || strcmp(argv[i], "-w") == 0) && i + 1 < argc) {
+            value = argv[++i];
+        } else if (strncmp(argv[i], "--workers=", 10) == 0) {
+            value = argv[i] + 10;
+        }
     }
     
-    state.running = 0;
+    int count = value ? atoi(value) : 1;
+    if (count <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        count = cpus > 0 ? (int)cpus : 1;
+    }
+    if (count > MAX_WORKERS) count = MAX_WORKERS;
+    return count;
+}
+
+static void signal_handler(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+int main(int argc, char** argv) {
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    signal(SIGPIPE, SIG_IGN);
+    
+    /* Keep shutdown signals on the main thread so pause() below wakes up. */
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+    
+    ServerState* state = calloc(1, sizeof(ServerState));
+    if (!state) return 1;
+    state->running = 1;
+    state->worker_count = parse_worker_count(argc, argv);
+    
+    /* Connections, their buffers and scratch, output and broadcast frames come from pools. */
+    state->client_pool = pool_create("clients", sizeof(Client), CLIENT_POOL_SLAB, POOL_GROW);
+    if (!state->client_pool || arena_init() < 0 || outq_init() < 0 || broadcast_init() < 0) {
+        fprintf(stderr, "Failed to create memory pools\n");
+        return 1;
+    }
+    
+    if (canon_publisher_init(&state->canon_source, CANON_MANIFEST, CANON_BIN_PATH) < 0) {
+        fprintf(stderr, "Failed to initialize canon\n");
+        return 1;
+    }
+    CanonSnapshot* snap = canon_snapshot_acquire(&state->canon_source);
+    if (session_table_init(&state->sessions, (uint32_t)snap->generation, (uint64_t)CANON_FRAME_MS * 1000000ULL,
+                           CANON_TICK_MS, broadcast_session_chunk, state) < 0) {
+        fprintf(stderr, "Failed to initialize sessions\n");
+        return 1;
+    }
+    
+    if (asset_cache_init(&state->assets, ASSET_ROUTES, sizeof(ASSET_ROUTES) / sizeof(ASSET_ROUTES[0])) < 0) {
+        fprintf(stderr, "Failed to initialize the asset cache\n");
+        return 1;
+    }
+    if (routes_init(state) < 0) {
+        fprintf(stderr, "Failed to build the route table\n");
+        return 1;
+    }
+    
+    broadcast_ring_init(&state->events);
+    if (ws_init(&state->ws, WS_PORT, &state->events) < 0) return 1;
+    sse_init(&state->sse, &state->events);
+    
+    for (int i = 0; i < state->worker_count; i++) {
+        if (worker_init(&state->workers[i], state, i) < 0) {
+            fprintf(stderr, "Failed to initialize worker %d\n", i);
+            return 1;
+        }
+    }
+    
+    pthread_t player_thread;
+    pthread_create(&player_thread, NULL, canon_player_thread, state);
+    
+    for (int i = 0; i < state->worker_count; i++) {
+        pthread_create(&state->workers[i].thread, NULL, worker_thread, &state->workers[i]);
+    }
+    
+    printf("Fano C Server running on port %d with %d worker%s\n",
+           PORT, state->worker_count, state->worker_count == 1 ? "" : "s");
+    printf("Loaded %zu canon chunks (reloaded on change)\n", snap->store.count);
+    canon_snapshot_release(snap);
+    printf("API endpoints:\n");
+    printf("  GET /api/canon       - Get canon state\n");
+    printf("  GET /api/play       - Start playback\n");
+    printf("  GET /api/pause      - Pause playback\n");
+    printf("  GET /api/stop       - Stop and reset\n");
+    printf("  GET /api/seek?0.5   - Seek to position (0-1)\n");
+    printf("  GET /api/speed?1.5  - Set playback speed\n");
+    printf("  GET /api/chunk/N    - Get chunk N\n");
+    printf("  GET /api/chunks?from=A&to=B[&fields=matrix,angle,seed][&format=bin] - Stream a range\n");
+    printf("  GET /api/fano/N     - Get Fano point N info\n");
+    printf("  GET /api/workers    - Per-worker reactor stats\n");
+    printf("  GET /api/clock      - Player frame timing and jitter\n");
+    printf("  GET /api/metrics    - Memory pool statistics\n");
+    printf("  GET /api/sessions   - List playback sessions\n");
+    printf("  GET /api/session/ID[/play|pause|stop|seek?0.5|speed?1.5|delete]\n");
+    printf("  GET /api/events[?session=ID] - Server-Sent Events stream\n");
+    
+    pthread_sigmask(SIG_UNBLOCK, &stop_signals, NULL);
+    while (!stop_requested) {
+        pause();
+    }
+    printf("\nShutting down...\n");
+    
+    state->running = 0;
+    for (int i = 0; i < state->worker_count; i++) {
+        pthread_join(state->workers[i].thread, NULL);
+        worker_destroy(&state->workers[i]);
+    }
     pthread_join(player_thread, NULL);
+    /* The lws thread reads sessions and the event log; it goes before either. */
+    ws_shutdown(&state->ws);
+    session_table_destroy(&state->sessions);
+    sse_shutdown(&state->sse);
+    broadcast_ring_clear(&state->events);
+    asset_cache_shutdown(&state->assets);
+    router_free(&state->router);
+    /* Every thread that used a pool has been joined by now; see pool_destroy. */
+    pool_destroy(state->client_pool);
+    arena_shutdown();
+    outq_shutdown();
+    broadcast_shutdown();
     
-    close(state.server_fd);
-    close(state.epoll_fd);
-    pthread_mutex_destroy(&state.canon_mutex);
-    free(state.canon.chunks);
+    canon_publisher_shutdown(&state->canon_source);
+    free(state);
     
     return 0;
 }
@@ -0,0 +1,338 @@
+#include "http_parser.h"
+#include <string.h>
+#include <strings.h>
+
+static int fail(HttpRequest* req, uint16_t status) {
+    req->status = status;
+    return HTTP_PARSE_ERROR;
+}
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static HttpSlice slice(size_t off, size_t len) {
+    HttpSlice s = { (uint32_t)off, (uint32_t)len };
+    return s;
+}
+
+static int slice_is(const char* data, HttpSlice s, const char* name) {
+    size_t len = strlen(name);
+    return s.len == len && strncasecmp(data + s.off, name, len) == 0;
+}
+
+/* Calls fn on each comma-separated element of value, trimmed; stops at the first that returns 1. */
+static int list_find(const char* value, size_t len, int (*fn)(const char*, size_t, const char*), const char* arg) {
+    size_t at = 0;
+    while (at < len) {
+        size_t end = at;
+        while (end < len && value[end] != ',') end++;
+        size_t start = at;
+        size_t stop = end;
+        while (start < stop && is_space(value[start])) start++;
+        while (stop > start && is_space(value[stop - 1])) stop--;
+        if (stop > start && fn(value + start, stop - start, arg)) return 1;
+        at = end + 1;
+    }
+    return 0;
+}
+
+static int token_equals(const char* item, size_t len, const char* token) {
+    return strlen(token) == len && strncasecmp(item, token, len) == 0;
+}
+
+static int etag_equals(const char* item, size_t len, const char* etag) {
+    if (len == 1 && item[0] == '*') return 1;
+    if (len > 2 && item[0] == 'W' && item[1] == '/') {
+        item += 2;
+        len -= 2;
+    }
+    if (etag[0] == 'W' && etag[1] == '/') etag += 2;
+    return strlen(etag) == len && memcmp(item, etag, len) == 0;
+}
+
+/* Whether a comma-separated header value such as Connection lists token, ignoring case. */
+int http_list_has(const char* value, size_t len, const char* token) {
+    return list_find(value, len, token_equals, token);
+}
+
+/* If-None-Match against the entity's tag, by the weak comparison GET uses; "*" matches anything. */
+int http_etag_match(const char* value, size_t len, const char* etag) {
+    return list_find(value, len, etag_equals, etag);
+}
+
+void http_request_reset(HttpRequest* req) {
+    memset(req, 0, sizeof(HttpRequest));
+    req->state = HTTP_STATE_HEAD;
+}
+
+const char* http_header(const HttpRequest* req, const char* data, const char* name, size_t* len) {
+    for (int i = 0; i < req->header_count; i++) {
+        if (slice_is(data, req->headers[i].name, name)) {
+            if (len) *len = req->headers[i].value.len;
+            return data + req->headers[i].value.off;
+        }
+    }
+    return NULL;
+}
+
+/* Finds the blank line that ends the head, resuming where the last call gave up; 0 while incomplete. */
+static size_t find_head_end(HttpRequest* req, const char* data, size_t len) {
+    size_t start = req->method.off;
+    size_t at = req->scan;
+    while (at < len) {
+        const char* nl = memchr(data + at, '\n', len - at);
+        if (!nl) break;
+        at = (size_t)(nl - data);
+        if (at >= start + 1 && data[at - 1] == '\n') return at + 1;
+        if (at >= start + 2 && data[at - 1] == '\r' && data[at - 2] == '\n') return at + 1;
+        at++;
+    }
+    req->scan = len;
+    return 0;
+}
+
+/* Length of the line at at, without its CRLF or bare LF; *next is where the following line starts. */
+static size_t line_at(const char* data, size_t at, size_t end, size_t* next) {
+    const char* nl = memchr(data + at, '\n', end - at);
+    size_t stop = nl ? (size_t)(nl - data) : end;
+    *next = nl ? stop + 1 : end;
+    if (stop > at && data[stop - 1] == '\r') stop--;
+    return stop - at;
+}
+
+static int parse_request_line(HttpRequest* req, const char* data, size_t at, size_t len) {
+    size_t i = at;
+    size_t stop = at + len;
+    while (i < stop && data[i] >= 'A' && data[i] <= 'Z') i++;
+    if (i == at || i - at > 16 || i >= stop || data[i] != ' ') return fail(req, 400);
+    req->method = slice(at, i - at);
+    
+    size_t target = ++i;
+    while (i < stop && data[i] != ' ') {
+        if ((unsigned char)data[i] <= 0x20 || data[i] == 0x7f) return fail(req, 400);
+        i++;
+    }
+    if (i == target || i >= stop) return fail(req, 400);
+    req->target = slice(target, i - target);
+    
+    const char* version = data + i + 1;
+    size_t version_len = stop - i - 1;
+    if (version_len != 8 || strncmp(version, "HTTP/", 5) != 0) return fail(req, 400);
+    if (version[5] != '1' || version[6] != '.') return fail(req, 505);
+    if (version[7] != '0' && version[7] != '1') return fail(req, 505);
+    req->minor_version = (uint8_t)(version[7] - '0');
+    req->keep_alive = req->minor_version == 1;
+    return 0;
+}
+
+static int parse_content_length(HttpRequest* req, const char* value, size_t len, int seen) {
+    if (len == 0) return fail(req, 400);
+    size_t length = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (value[i] < '0' || value[i] > '9') return fail(req, 400);
+        if (length > (SIZE_MAX - 9) / 10) return fail(req, 413);
+        length = length * 10 + (size_t)(value[i] - '0');
+    }
+    /* Repeats must agree, or the two ends could disagree on where the body stops. */
+    if (seen && length != req->content_length) return fail(req, 400);
+    req->content_length = length;
+    return 0;
+}
+
+/*
+ * Only a bare chunked is accepted: nothing here undoes other codings, so
+ * "gzip, chunked" would hand handlers compressed bytes as the body.
+ * A second Transfer-Encoding field naming chunked again is malformed.
+ */
+static int parse_transfer_encoding(HttpRequest* req, const char* value, size_t len) {
+    if (!token_equals(value, len, "chunked")) return fail(req, 501);
+    if (req->chunked) return fail(req, 400);
+    req->chunked = 1;
+    return 0;
+}
+
+/*
+ * One pass over a complete head: the request line, then each field as a
+ * name and trimmed value slice. The fields that decide framing and the
+ * connection are interpreted here; everything else is left to
+ * http_header. Folded lines and Content-Length next to chunked are
+ * refused rather than guessed at.
+ */
+static int parse_head(HttpRequest* req, const char* data, size_t end) {
+    size_t next;
+    size_t len = line_at(data, req->method.off, end, &next);
+    if (parse_request_line(req, data, req->method.off, len) < 0) return HTTP_PARSE_ERROR;
+    
+    int has_length = 0;
+    size_t at = next;
+    while (at < end) {
+        len = line_at(data, at, end, &next);
+        if (len == 0) break;
+        if (is_space(data[at])) return fail(req, 400);
+        
+        const char* line = data + at;
+        const char* colon = memchr(line, ':', len);
+        if (!colon || colon == line) return fail(req, 400);
+        size_t name_len = (size_t)(colon - line);
+        for (size_t i = 0; i < name_len; i++) {
+            if ((unsigned char)line[i] <= 0x20) return fail(req, 400);
+        }
+        size_t value_start = name_len + 1;
+        size_t value_end = len;
+        while (value_start < value_end && is_space(line[value_start])) value_start++;
+        while (value_end > value_start && is_space(line[value_end - 1])) value_end--;
+        
+        if (req->header_count >= HTTP_MAX_HEADERS) return fail(req, 431);
+        HttpHeader* header = &req->headers[req->header_count++];
+        header->name = slice(at, name_len);
+        header->value = slice(at + value_start, value_end - value_start);
+        
+        const char* value = line + value_start;
+        size_t value_len = value_end - value_start;
+        if (slice_is(data, header->name, "Content-Length")) {
+            if (parse_content_length(req, value, value_len, has_length) < 0) return HTTP_PARSE_ERROR;
+            has_length = 1;
+        } else if (slice_is(data, header->name, "Transfer-Encoding")) {
+            if (parse_transfer_encoding(req, value, value_len) < 0) return HTTP_PARSE_ERROR;
+        } else if (slice_is(data, header->name, "Connection")) {
+            if (http_list_has(value, value_len, "close")) req->keep_alive = 0;
+            else if (http_list_has(value, value_len, "keep-alive")) req->keep_alive = 1;
+        } else if (slice_is(data, header->name, "Expect")) {
+            if (req->minor_version == 1 && http_list_has(value, value_len, "100-continue")) req->expect_continue = 1;
+        }
+        at = next;
+    }
+    if (req->chunked && has_length) return fail(req, 400);
+    return 0;
+}
+
+/* Hex size, then optional extensions after ';' that we ignore. */
+static int parse_chunk_size(const char* line, size_t len, size_t* size) {
+    size_t value = 0;
+    size_t i = 0;
+    for (; i < len; i++) {
+        char c = line[i];
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else break;
+        if (value > (SIZE_MAX >> 4)) return -1;
+        value = (value << 4) | (size_t)digit;
+    }
+    if (i == 0) return -1;
+    while (i < len && is_space(line[i])) i++;
+    if (i < len && line[i] != ';') return -1;
+    *size = value;
+    return 0;
+}
+
+/*
+ * Walks chunk framing from scan and slides each chunk's data down to the
+ * end of the body decoded so far. Trailer fields are read past and
+ * dropped.
+ */
+static int parse_chunks(HttpRequest* req, char* data, size_t len, size_t max) {
+    while (req->state != HTTP_STATE_DONE) {
+        if (req->state == HTTP_STATE_CHUNK_DATA) {
+            size_t n = len - req->scan;
+            if (n > req->chunk_left) n = req->chunk_left;
+            if (n == 0) break;
+            memmove(data + req->body_off + req->body_len, data + req->scan, n);
+            req->body_len += n;
+            req->scan += n;
+            req->chunk_left -= n;
+            if (req->chunk_left == 0) req->state = HTTP_STATE_CHUNK_END;
+            continue;
+        }
+        
+        if (req->state == HTTP_STATE_CHUNK_END) {
+            if (req->scan >= len) break;
+            if (data[req->scan] == '\n') {
+                req->scan++;
+            } else if (data[req->scan] == '\r') {
+                if (req->scan + 1 >= len) break;
+                if (data[req->scan + 1] != '\n') return fail(req, 400);
+                req->scan += 2;
+            } else {
+                return fail(req, 400);
+            }
+            req->state = HTTP_STATE_CHUNK_SIZE;
+            continue;
+        }
+        
+        const char* nl = memchr(data + req->scan, '\n', len - req->scan);
+        if (!nl) {
+            if (len - req->scan > HTTP_MAX_LINE) return fail(req, 400);
+            break;
+        }
+        size_t next;
+        size_t line_len = line_at(data, req->scan, len, &next);
+        if (req->state == HTTP_STATE_CHUNK_SIZE) {
+            size_t size;
+            if (parse_chunk_size(data + req->scan, line_len, &size) < 0) return fail(req, 400);
+            if (size > max - req->body_off - req->body_len) return fail(req, 413);
+            req->chunk_left = size;
+            req->state = size ? HTTP_STATE_CHUNK_DATA : HTTP_STATE_TRAILER;
+        } else if (line_len == 0) {
+            req->state = HTTP_STATE_DONE;
+            req->length = next;
+        }
+        req->scan = next;
+    }
+    
+    if (req->state == HTTP_STATE_DONE) return HTTP_PARSE_DONE;
+    if (len >= max) return fail(req, 413);
+    return HTTP_PARSE_MORE;
+}
+
+/*
+ * Advances the parse over data[0..len), the request as far as it has
+ * arrived; len only grows between calls for the same request. max is the
+ * most the whole request may take, since it has to fit in the caller's
+ * buffer. Returns HTTP_PARSE_DONE once length bytes make up the request,
+ * HTTP_PARSE_MORE to wait for input, or HTTP_PARSE_ERROR with status set.
+ */
+int http_parse(HttpRequest* req, char* data, size_t len, size_t max) {
+    if (req->state == HTTP_STATE_HEAD) {
+        /* Stray CRLFs between pipelined requests are skipped, as RFC 9112 allows. */
+        while (req->scan < len && req->scan == req->method.off &&
+               (data[req->scan] == '\r' || data[req->scan] == '\n')) {
+            req->method.off = (uint32_t)++req->scan;
+        }
+        size_t end = find_head_end(req, data, len);
+        if (!end) return len >= max ? fail(req, 431) : HTTP_PARSE_MORE;
+        if (parse_head(req, data, end) < 0) return HTTP_PARSE_ERROR;
+        
+        req->head_len = end;
+        req->scan = end;
+        req->body_off = end;
+        if (req->chunked) {
+            req->state = HTTP_STATE_CHUNK_SIZE;
+        } else if (req->content_length > 0) {
+            if (req->content_length > max - end) return fail(req, 413);
+            req->state = HTTP_STATE_BODY;
+        } else {
+            req->state = HTTP_STATE_DONE;
+            req->length = end;
+            return HTTP_PARSE_DONE;
+        }
+    }
+    
+    switch (req->state) {
+        case HTTP_STATE_BODY:
+            if (len - req->head_len < req->content_length) {
+                req->scan = len;
+                return HTTP_PARSE_MORE;
+            }
+            req->body_len = req->content_length;
+            req->length = req->head_len + req->content_length;
+            req->state = HTTP_STATE_DONE;
+            return HTTP_PARSE_DONE;
+        case HTTP_STATE_DONE:
+            return HTTP_PARSE_DONE;
+        default:
+            return parse_chunks(req, data, len, max);
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define HTTP_MAX_HEADERS 32
+#define HTTP_MAX_LINE 8192
+
+#define HTTP_PARSE_DONE 1
+#define HTTP_PARSE_MORE 0
+#define HTTP_PARSE_ERROR -1
+
+enum {
+    HTTP_STATE_HEAD,
+    HTTP_STATE_BODY,
+    HTTP_STATE_CHUNK_SIZE,
+    HTTP_STATE_CHUNK_DATA,
+    HTTP_STATE_CHUNK_END,
+    HTTP_STATE_TRAILER,
+    HTTP_STATE_DONE
+};
+
+/* Bytes at off..off+len, counted from the start of the request. */
+typedef struct {
+    uint32_t off;
+    uint32_t len;
+} HttpSlice;
+
+typedef struct {
+    HttpSlice name;
+    HttpSlice value;
+} HttpHeader;
+
+/*
+ * One HTTP/1.x request, parsed where it lies in the read buffer. Nothing
+ * is copied: the request line and headers are slices of the buffer, and
+ * positions are offsets rather than pointers so the buffer may grow or be
+ * compacted between calls. Parsing resumes at scan, so a request that
+ * trickles in a few bytes at a time is still looked at once. A chunked
+ * body is decoded in place into one run at body_off, over the chunk
+ * framing it has already passed.
+ */
+typedef struct {
+    uint8_t state;
+    uint8_t minor_version;
+    uint8_t keep_alive;
+    uint8_t chunked;
+    uint8_t expect_continue;
+    uint16_t status;               /* what to answer with after HTTP_PARSE_ERROR */
+    size_t scan;
+    HttpSlice method;
+    HttpSlice target;
+    HttpHeader headers[HTTP_MAX_HEADERS];
+    int header_count;
+    size_t head_len;
+    size_t content_length;
+    size_t chunk_left;
+    size_t body_off;
+    size_t body_len;
+    size_t length;                 /* the whole request, framing included, once done */
+} HttpRequest;
+
+void http_request_reset(HttpRequest* req);
+int http_parse(HttpRequest* req, char* data, size_t len, size_t max);
+
+const char* http_header(const HttpRequest* req, const char* data, const char* name, size_t* len);
+int http_list_has(const char* value, size_t len, const char* token);
+int http_etag_match(const char* value, size_t len, const char* etag);
+
+#endif
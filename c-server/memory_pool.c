@@ -0,0 +1,410 @@
+#include "memory_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * One thread's free blocks for one pool; items is used as a stack. The
+ * counters are only written by the owning thread and read by pool_stats.
+ */
+typedef struct PoolCache {
+    MemoryPool* pool;
+    struct PoolCache* next;
+    _Atomic uint64_t allocs;
+    _Atomic uint64_t frees;
+    uint32_t count;
+    uint32_t items[POOL_CACHE];
+} PoolCache;
+
+static _Atomic(MemoryPool*) pool_registry[POOL_MAX_POOLS];
+static atomic_int pool_next_id = 0;
+static __thread PoolCache* pool_caches[POOL_MAX_POOLS];
+static pthread_key_t pool_key;
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+
+static inline void counter_bump(_Atomic uint64_t* counter) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+static void counter_max(_Atomic uint64_t* counter, uint64_t value) {
+    uint64_t seen = atomic_load_explicit(counter, memory_order_relaxed);
+    while (value > seen && !atomic_compare_exchange_weak_explicit(counter, &seen, value,
+                                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static PoolBlock* block_at(MemoryPool* pool, uint32_t index) {
+    unsigned char* slab = atomic_load_explicit(&pool->slabs[index >> pool->slab_shift], memory_order_acquire);
+    return (PoolBlock*)(slab + (size_t)(index & ((1u << pool->slab_shift) - 1)) * pool->stride);
+}
+
+#ifdef POOL_DEBUG
+/* Flips a block's live bit; returns the bit as it was. */
+static int live_set(MemoryPool* pool, uint32_t index, int live) {
+    _Atomic uint64_t* words = atomic_load(&pool->live[index >> pool->slab_shift]);
+    uint32_t bit = index & ((1u << pool->slab_shift) - 1);
+    uint64_t mask = 1ull << (bit & 63);
+    uint64_t old = live ? atomic_fetch_or(&words[bit >> 6], mask) : atomic_fetch_and(&words[bit >> 6], ~mask);
+    return (old & mask) != 0;
+}
+
+/* Does ptr point at the data of one of this pool's blocks? */
+static int block_owned(MemoryPool* pool, void* ptr) {
+    uint32_t slabs = atomic_load(&pool->slab_count);
+    for (uint32_t i = 0; i < slabs; i++) {
+        unsigned char* slab = atomic_load(&pool->slabs[i]);
+        unsigned char* data = (unsigned char*)ptr - POOL_HEADER;
+        if (data < slab || data >= slab + (pool->stride << pool->slab_shift)) continue;
+        return (size_t)(data - slab) % pool->stride == 0;
+    }
+    return 0;
+}
+
+static void poison_check(MemoryPool* pool, unsigned char* data) {
+    for (size_t i = 0; i < pool->block_size; i++) {
+        if (data[i] != POOL_POISON) {
+            atomic_fetch_add(&pool->poison_errors, 1);
+            fprintf(stderr, "pool %s: block %p written after free (offset %zu)\n", pool->name, (void*)data, i);
+            return;
+        }
+    }
+}
+#endif
+
+static uint64_t depot_tag(uint64_t old, uint32_t index) {
+    return (((old >> 32) + 1) << 32) | index;
+}
+
+/* Pushes the batch starting at head, already linked through next. */
+static void depot_push(MemoryPool* pool, uint32_t head, uint32_t count) {
+    PoolBlock* block = block_at(pool, head);
+    block->count = count;
+    atomic_fetch_add_explicit(&pool->depot_blocks, count, memory_order_relaxed);
+    uint64_t old = atomic_load_explicit(&pool->depot, memory_order_relaxed);
+    do {
+        atomic_store_explicit(&block->next_batch, (uint32_t)old, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&pool->depot, &old, depot_tag(old, head),
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+/*
+ * Pops a whole batch. next_batch may be stale by the time it is read, but
+ * then the head has moved and its tag with it, so the CAS fails.
+ */
+static uint32_t depot_pop(MemoryPool* pool) {
+    uint64_t old = atomic_load_explicit(&pool->depot, memory_order_acquire);
+    while ((uint32_t)old != POOL_NIL) {
+        PoolBlock* block = block_at(pool, (uint32_t)old);
+        uint32_t next = atomic_load_explicit(&block->next_batch, memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&pool->depot, &old, depot_tag(old, next),
+                                                  memory_order_acquire, memory_order_acquire)) {
+            uint64_t held = atomic_fetch_sub_explicit(&pool->depot_blocks, block->count,
+                                                      memory_order_relaxed) - block->count;
+            uint64_t capacity = pool_capacity(pool);
+            if (capacity > held) counter_max(&pool->peak_out, capacity - held);
+            return (uint32_t)old;
+        }
+    }
+    return POOL_NIL;
+}
+
+/* Carves a new slab into batches for the depot. Returns -1 when the pool may not grow. */
+static int pool_add_slab(MemoryPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    /* Someone else may have grown it, or returned a batch, while we waited. */
+    if ((uint32_t)atomic_load(&pool->depot) != POOL_NIL) {
+        pthread_mutex_unlock(&pool->lock);
+        return 0;
+    }
+    uint32_t slab_index = atomic_load(&pool->slab_count);
+    if (slab_index >= POOL_MAX_SLABS || (slab_index > 0 && !pool->grow)) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    
+    uint32_t blocks = 1u << pool->slab_shift;
+    unsigned char* slab = malloc(pool->stride * blocks);
+    if (!slab) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+#ifdef POOL_DEBUG
+    _Atomic uint64_t* live = calloc((blocks + 63) / 64, sizeof(uint64_t));
+    if (!live) {
+        free(slab);
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    atomic_store(&pool->live[slab_index], live);
+#endif
+    uint32_t base = slab_index << pool->slab_shift;
+    for (uint32_t i = 0; i < blocks; i++) {
+        PoolBlock* block = (PoolBlock*)(slab + (size_t)i * pool->stride);
+        block->index = base + i;
+        atomic_init(&block->next, (i + 1) % POOL_BATCH == 0 || i + 1 == blocks ? POOL_NIL : base + i + 1);
+        atomic_init(&block->next_batch, POOL_NIL);
+        block->count = 0;
+#ifdef POOL_DEBUG
+        memset((unsigned char*)block + POOL_HEADER, POOL_POISON, pool->block_size);
+#endif
+    }
+    atomic_store_explicit(&pool->slabs[slab_index], slab, memory_order_release);
+    for (uint32_t i = 0; i < blocks; i += POOL_BATCH) {
+        depot_push(pool, base + i, blocks - i < POOL_BATCH ? blocks - i : POOL_BATCH);
+    }
+    /* Counted once its blocks are in the depot, so peak_out never sees them as taken. */
+    atomic_store(&pool->slab_count, slab_index + 1);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+/* Hands the top count cached blocks back to the depot as one batch. */
+static void cache_flush(PoolCache* cache, uint32_t count) {
+    MemoryPool* pool = cache->pool;
+    uint32_t first = cache->count - count;
+    for (uint32_t i = first; i < cache->count; i++) {
+        uint32_t next = i + 1 < cache->count ? cache->items[i + 1] : POOL_NIL;
+        atomic_store_explicit(&block_at(pool, cache->items[i])->next, next, memory_order_relaxed);
+    }
+    depot_push(pool, cache->items[first], count);
+    cache->count = first;
+}
+
+static int cache_refill(PoolCache* cache) {
+    MemoryPool* pool = cache->pool;
+    uint32_t head = depot_pop(pool);
+    while (head == POOL_NIL) {
+        if (pool_add_slab(pool) < 0) return -1;
+        head = depot_pop(pool);
+    }
+    for (uint32_t index = head; index != POOL_NIL && cache->count < POOL_CACHE; ) {
+        cache->items[cache->count++] = index;
+        index = atomic_load_explicit(&block_at(pool, index)->next, memory_order_relaxed);
+    }
+    return 0;
+}
+
+/* Thread exit: give every cached block back and fold the counters into the pool. */
+static void cache_release_all(void* arg) {
+    PoolCache** caches = (PoolCache**)arg;
+    for (int id = 0; id < POOL_MAX_POOLS; id++) {
+        PoolCache* cache = caches[id];
+        if (!cache) continue;
+        MemoryPool* pool = cache->pool;
+        if (atomic_load(&pool_registry[id]) == pool) {
+            if (cache->count) cache_flush(cache, cache->count);
+            pthread_mutex_lock(&pool->lock);
+            PoolCache** link = &pool->caches;
+            while (*link && *link != cache) link = &(*link)->next;
+            if (*link) *link = cache->next;
+            pool->retired_allocs += atomic_load(&cache->allocs);
+            pool->retired_frees += atomic_load(&cache->frees);
+            pthread_mutex_unlock(&pool->lock);
+        }
+        free(cache);
+        caches[id] = NULL;
+    }
+}
+
+static void pool_key_create(void) {
+    pthread_key_create(&pool_key, cache_release_all);
+}
+
+static PoolCache* cache_get(MemoryPool* pool) {
+    PoolCache* cache = pool_caches[pool->id];
+    if (cache) return cache;
+    
+    /* Once per thread and pool, for the life of the thread. */
+    pthread_once(&pool_key_once, pool_key_create);
+    cache = malloc(sizeof(PoolCache));
+    if (!cache) return NULL;
+    cache->pool = pool;
+    atomic_init(&cache->allocs, 0);
+    atomic_init(&cache->frees, 0);
+    cache->count = 0;
+    pthread_mutex_lock(&pool->lock);
+    cache->next = pool->caches;
+    pool->caches = cache;
+    pthread_mutex_unlock(&pool->lock);
+    pool_caches[pool->id] = cache;
+    pthread_setspecific(pool_key, pool_caches);
+    return cache;
+}
+
+/*
+ * slab_blocks is rounded up to a power of two of at least POOL_BATCH; the
+ * first slab is carved up front, more only for POOL_GROW pools.
+ */
+MemoryPool* pool_create(const char* name, size_t block_size, size_t slab_blocks, int flags) {
+    int id = atomic_fetch_add(&pool_next_id, 1);
+    if (id >= POOL_MAX_POOLS) {
+        fprintf(stderr, "pool %s: too many pools\n", name);
+        return NULL;
+    }
+    
+    MemoryPool* pool = calloc(1, sizeof(MemoryPool));
+    if (!pool) return NULL;
+    pool->id = id;
+    pool->name = name;
+    pool->block_size = block_size;
+    pool->stride = POOL_HEADER + ((block_size + 15) & ~(size_t)15);
+    pool->slab_shift = 5;
+    while ((1ul << pool->slab_shift) < slab_blocks && pool->slab_shift < 20) pool->slab_shift++;
+    pool->grow = (flags & POOL_GROW) != 0;
+    atomic_init(&pool->depot, POOL_NIL);
+    atomic_init(&pool->slab_count, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    
+    if (pool_add_slab(pool) < 0) {
+        pthread_mutex_destroy(&pool->lock);
+        free(pool);
+        return NULL;
+    }
+    atomic_store(&pool_registry[id], pool);
+    return pool;
+}
+
+/* Returns an uninitialised block, or NULL when the pool is exhausted. */
+void* pool_alloc(MemoryPool* pool) {
+    PoolCache* cache = cache_get(pool);
+    if (!cache || (cache->count == 0 && cache_refill(cache) < 0)) {
+        atomic_fetch_add_explicit(&pool->failed, 1, memory_order_relaxed);
+        return NULL;
+    }
+    counter_bump(&cache->allocs);
+    uint32_t index = cache->items[--cache->count];
+    unsigned char* data = (unsigned char*)block_at(pool, index) + POOL_HEADER;
+#ifdef POOL_DEBUG
+    poison_check(pool, data);
+    memset(data, POOL_FILL, pool->block_size);
+    if (live_set(pool, index, 1)) {
+        fprintf(stderr, "pool %s: block %p handed out twice\n", pool->name, (void*)data);
+    }
+    counter_max(&pool->live_peak, atomic_fetch_add(&pool->live_count, 1) + 1);
+#endif
+    return data;
+}
+
+/* Any thread may free a block, whichever thread allocated it. */
+void pool_free(MemoryPool* pool, void* ptr) {
+    if (!ptr) return;
+    PoolBlock* block = (PoolBlock*)((unsigned char*)ptr - POOL_HEADER);
+#ifdef POOL_DEBUG
+    if (!block_owned(pool, ptr)) {
+        atomic_fetch_add(&pool->foreign_frees, 1);
+        fprintf(stderr, "pool %s: free of foreign pointer %p\n", pool->name, ptr);
+        return;
+    }
+    if (!live_set(pool, block->index, 0)) {
+        atomic_fetch_add(&pool->double_frees, 1);
+        fprintf(stderr, "pool %s: double free of %p\n", pool->name, ptr);
+        return;
+    }
+    atomic_fetch_sub(&pool->live_count, 1);
+    memset(ptr, POOL_POISON, pool->block_size);
+#endif
+    PoolCache* cache = cache_get(pool);
+    if (!cache) {
+        atomic_store_explicit(&block->next, POOL_NIL, memory_order_relaxed);
+        depot_push(pool, block->index, 1);
+        return;
+    }
+    counter_bump(&cache->frees);
+    if (cache->count == POOL_CACHE) cache_flush(cache, POOL_BATCH);
+    cache->items[cache->count++] = block->index;
+}
+
+/*
+ * Threads that have exited already unlinked their caches, so anything
+ * left besides our own belongs to a thread that is still running. Its
+ * cache cannot be freed from here; it is reported and left for that
+ * thread's exit, which sees the pool gone from the registry.
+ */
+void pool_destroy(MemoryPool* pool) {
+    if (!pool) return;
+    atomic_store(&pool_registry[pool->id], NULL);
+    PoolCache* own = pool_caches[pool->id];
+    int held = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (PoolCache* cache = pool->caches; cache; cache = cache->next) {
+        if (cache != own) held++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (held) {
+        fprintf(stderr, "pool %s: destroyed while %d other thread(s) still hold a cache\n", pool->name, held);
+    }
+    free(own);
+    pool_caches[pool->id] = NULL;
+    
+    uint32_t slabs = atomic_load(&pool->slab_count);
+    for (uint32_t i = 0; i < slabs; i++) {
+        free(atomic_load(&pool->slabs[i]));
+#ifdef POOL_DEBUG
+        free(atomic_load(&pool->live[i]));
+#endif
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+void pool_stats(MemoryPool* pool, PoolStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->name = pool->name;
+    stats->block_size = pool->block_size;
+    stats->capacity = pool_capacity(pool);
+    stats->slabs = atomic_load(&pool->slab_count);
+    stats->failed = atomic_load(&pool->failed);
+    stats->peak_out = atomic_load(&pool->peak_out);
+    
+    pthread_mutex_lock(&pool->lock);
+    stats->allocs = pool->retired_allocs;
+    stats->frees = pool->retired_frees;
+    for (PoolCache* cache = pool->caches; cache; cache = cache->next) {
+        stats->allocs += atomic_load_explicit(&cache->allocs, memory_order_relaxed);
+        stats->frees += atomic_load_explicit(&cache->frees, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+#ifdef POOL_DEBUG
+    stats->live = atomic_load(&pool->live_count);
+    stats->live_peak = atomic_load(&pool->live_peak);
+    stats->double_frees = atomic_load(&pool->double_frees);
+    stats->foreign_frees = atomic_load(&pool->foreign_frees);
+    stats->poison_errors = atomic_load(&pool->poison_errors);
+#endif
+}
+
+/* Every live pool as {"debug":..,"pools":[..]}; returns the length, 0 if cap was too small. */
+size_t pool_metrics_json(char* out, size_t cap) {
+#ifdef POOL_DEBUG
+    const int debug = 1;
+#else
+    const int debug = 0;
+#endif
+    size_t len = (size_t)snprintf(out, cap, "{\"debug\":%s,\"pools\":[", debug ? "true" : "false");
+    int first = 1;
+    for (int id = 0; id < POOL_MAX_POOLS && len < cap; id++) {
+        MemoryPool* pool = atomic_load(&pool_registry[id]);
+        if (!pool) continue;
+        PoolStats stats;
+        pool_stats(pool, &stats);
+        len += (size_t)snprintf(out + len, cap - len,
+            "%s{\"name\":\"%s\",\"block_size\":%zu,\"capacity\":%zu,\"slabs\":%u,"
+            "\"allocs\":%lu,\"frees\":%lu,\"in_use\":%lu,\"peak_out\":%lu,\"failed\":%lu",
+            first ? "" : ",", stats.name, stats.block_size, stats.capacity, stats.slabs,
+            (unsigned long)stats.allocs, (unsigned long)stats.frees,
+            (unsigned long)(stats.allocs > stats.frees ? stats.allocs - stats.frees : 0),
+            (unsigned long)stats.peak_out, (unsigned long)stats.failed);
+        if (debug && len < cap) {
+            len += (size_t)snprintf(out + len, cap - len,
+                ",\"live\":%lu,\"live_peak\":%lu,\"double_frees\":%lu,\"foreign_frees\":%lu,\"poison_errors\":%lu",
+                (unsigned long)stats.live, (unsigned long)stats.live_peak,
+                (unsigned long)stats.double_frees, (unsigned long)stats.foreign_frees,
+                (unsigned long)stats.poison_errors);
+        }
+        if (len < cap) len += (size_t)snprintf(out + len, cap - len, "}");
+        first = 0;
+    }
+    if (len < cap) len += (size_t)snprintf(out + len, cap - len, "]}");
+    return len < cap ? len : 0;
+}
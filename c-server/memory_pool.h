@@ -1,80 +1,115 @@
 #ifndef MEMORY_POOL_H
 #define MEMORY_POOL_H
 
-#include <stdlib.h>
+#include <stdatomic.h>
 #include <stdint.h>
-#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
 
+#define POOL_MAX_POOLS 32
+#define POOL_MAX_SLABS 1024
+#define POOL_BATCH 32
+#define POOL_CACHE (2 * POOL_BATCH)
+#define POOL_HEADER 16
+#define POOL_NIL 0xFFFFFFFFu
+
+/* POOL_DEBUG fill patterns: freed blocks, and blocks just handed out. */
+#define POOL_POISON 0xDD
+#define POOL_FILL 0xCD
+
+/* pool_create flags */
+#define POOL_FIXED 0
+#define POOL_GROW 1
+
+/*
+ * Fixed-size block allocator shared by every thread. Each thread keeps a
+ * small cache of free blocks per pool and only touches shared state to
+ * trade a whole batch of POOL_BATCH blocks with the depot, a lock-free
+ * stack of batches. Blocks are numbered; the depot head is a 32-bit tag
+ * and a block index in one word, so the CAS cannot be fooled by a batch
+ * that was popped and pushed back in between. A free block's links live
+ * in its POOL_HEADER-byte header, in front of the pointer handed out.
+ * When the depot runs dry a POOL_GROW pool adds a slab under a mutex;
+ * slabs are only released by pool_destroy.
+ *
+ * Each thread counts its own allocations and frees, and the depot counts
+ * the blocks it holds, so the statistics cost no shared writes on the
+ * fast path. Building with -DPOOL_DEBUG adds exact live counts, a
+ * live-block bitmap that catches double and foreign frees, and poisoning
+ * of freed blocks that is checked again when they are handed out.
+ */
 typedef struct {
-    void* blocks;
+    uint32_t index;
+    _Atomic uint32_t next;        /* next block in the same batch */
+    _Atomic uint32_t next_batch;  /* next batch in the depot, head blocks only */
+    uint32_t count;               /* blocks in this batch, head blocks only */
+} PoolBlock;
+
+typedef struct {
+    int id;
+    const char* name;
     size_t block_size;
-    size_t block_count;
-    size_t free_count;
-    uint8_t* free_list;
-    size_t next_free;
+    size_t stride;
+    uint32_t slab_shift;
+    uint8_t grow;
+    _Atomic uint64_t depot;
+    _Atomic(unsigned char*) slabs[POOL_MAX_SLABS];
+    atomic_uint slab_count;
+    pthread_mutex_t lock;           /* growth and the cache list */
+    struct PoolCache* caches;
+    uint64_t retired_allocs;        /* from caches of threads that have exited */
+    uint64_t retired_frees;
+    _Atomic uint64_t depot_blocks;
+    _Atomic uint64_t peak_out;
+    _Atomic uint64_t failed;
+#ifdef POOL_DEBUG
+    _Atomic(_Atomic uint64_t*) live[POOL_MAX_SLABS];
+    _Atomic uint64_t live_count;
+    _Atomic uint64_t live_peak;
+    _Atomic uint64_t double_frees;
+    _Atomic uint64_t foreign_frees;
+    _Atomic uint64_t poison_errors;
+#endif
 } MemoryPool;
 
-static MemoryPool* pool_create(size_t block_size, size_t block_count) {
-    MemoryPool* pool = malloc(sizeof(MemoryPool));
-    if (!pool) return NULL;
-    
-    pool->block_size = block_size;
-    pool->block_count = block_count;
-    pool->free_count = block_count;
-    
-    pool->blocks = malloc(block_size * block_count);
-    pool->free_list = malloc(block_count * sizeof(uint8_t));
-    
-    if (!pool->blocks || !pool->free_list) {
-        free(pool->blocks);
-        free(pool->free_list);
-        free(pool);
-        return NULL;
-    }
-    
-    memset(pool->free_list, 1, block_count);
-    pool->next_free = 0;
-    
-    return pool;
-}
+/*
+ * peak_out is the most blocks that were ever out of the depot at once,
+ * in use or sitting in a thread cache; it is what the pool had to hold.
+ * The live and error counts are only kept by POOL_DEBUG builds.
+ */
+typedef struct {
+    const char* name;
+    size_t block_size;
+    size_t capacity;
+    uint32_t slabs;
+    uint64_t allocs;
+    uint64_t frees;
+    uint64_t failed;
+    uint64_t peak_out;
+    uint64_t live;
+    uint64_t live_peak;
+    uint64_t double_frees;
+    uint64_t foreign_frees;
+    uint64_t poison_errors;
+} PoolStats;
 
-static void* pool_alloc(MemoryPool* pool) {
-    if (pool->free_count == 0) return NULL;
-    
-    size_t attempts = 0;
-    while (!pool->free_list[pool->next_free] && attempts < pool->block_count) {
-        pool->next_free = (pool->next_free + 1) % pool->block_count;
-        attempts++;
-    }
-    
-    if (attempts >= pool->block_count) return NULL;
-    
-    size_t idx = pool->next_free;
-    pool->free_list[idx] = 0;
-    pool->free_count--;
-    pool->next_free = (pool->next_free + 1) % pool->block_count;
-    
-    return (char*)pool->blocks + (idx * pool->block_size);
-}
+MemoryPool* pool_create(const char* name, size_t block_size, size_t slab_blocks, int flags);
+void* pool_alloc(MemoryPool* pool);
+void pool_free(MemoryPool* pool, void* ptr);
+/*
+ * Releases every slab. By then every other thread that ever allocated
+ * from or freed to the pool must have exited (been joined), since each
+ * such thread holds a cache pointing into it; only the calling thread's
+ * cache is freed here. Blocks still out become invalid.
+ */
+void pool_destroy(MemoryPool* pool);
 
-static void pool_free(MemoryPool* pool, void* ptr) {
-    if (!ptr) return;
-    
-    ptrdiff_t offset = (char*)ptr - (char*)pool->blocks;
-    if (offset < 0 || offset % pool->block_size != 0) return;
-    
-    size_t idx = offset / pool->block_size;
-    if (idx < pool->block_count) {
-        pool->free_list[idx] = 1;
-        pool->free_count++;
-    }
-}
+void pool_stats(MemoryPool* pool, PoolStats* stats);
+size_t pool_metrics_json(char* out, size_t cap);
 
-static void pool_destroy(MemoryPool* pool) {
-    if (!pool) return;
-    free(pool->blocks);
-    free(pool->free_list);
-    free(pool);
+/* Blocks the pool has carved so far, free or not. */
+static inline size_t pool_capacity(MemoryPool* pool) {
+    return (size_t)atomic_load(&pool->slab_count) << pool->slab_shift;
 }
 
 #endif
@@ -0,0 +1,297 @@
+#include "ndjson.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Finds the next '"' or '\\' — the only bytes that matter inside a string. */
+static const char* scan_string(const char* p, const char* end) {
+#if defined(__AVX2__)
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    while (p + 32 <= end) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)p);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, quote), _mm256_cmpeq_epi8(block, backslash)));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i quote16 = _mm_set1_epi8('"');
+    const __m128i backslash16 = _mm_set1_epi8('\\');
+    while (p + 16 <= end) {
+        __m128i block = _mm_loadu_si128((const __m128i*)p);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(block, quote16), _mm_cmpeq_epi8(block, backslash16)));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '"' && *p != '\\') p++;
+    return p;
+}
+
+static const char* skip_space(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+    return p;
+}
+
+/* p points just past the opening quote; returns the closing quote or NULL. */
+static const char* string_end(const char* p, const char* end, uint8_t* has_escapes) {
+    while (1) {
+        p = scan_string(p, end);
+        if (p >= end) return NULL;
+        if (*p == '"') return p;
+        *has_escapes = 1;
+        p += 2;
+    }
+}
+
+/* Skips a nested array or object, honoring strings; returns one past its end. */
+static const char* skip_container(const char* p, const char* end) {
+    int depth = 0;
+    while (p < end) {
+        char c = *p;
+        if (c == '"') {
+            uint8_t escapes = 0;
+            p = string_end(p + 1, end, &escapes);
+            if (!p) return NULL;
+        } else if (c == '[' || c == '{') {
+            depth++;
+        } else if (c == ']' || c == '}') {
+            if (--depth == 0) return p + 1;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+int ndjson_parse_object(const char* line, size_t len, ndjson_field_fn on_field, void* ctx) {
+    const char* end = line + len;
+    const char* p = skip_space(line, end);
+    if (p >= end || *p != '{') return -1;
+    p = skip_space(p + 1, end);
+    if (p < end && *p == '}') return 0;
+    
+    while (p < end) {
+        NdjsonField field;
+        memset(&field, 0, sizeof(field));
+        
+        if (*p != '"') return -1;
+        uint8_t key_escapes = 0;
+        const char* key_end = string_end(p + 1, end, &key_escapes);
+        if (!key_end) return -1;
+        field.key = p + 1;
+        field.key_len = (size_t)(key_end - field.key);
+        
+        p = skip_space(key_end + 1, end);
+        if (p >= end || *p != ':') return -1;
+        p = skip_space(p + 1, end);
+        if (p >= end) return -1;
+        
+        const char* value_end;
+        switch (*p) {
+            case '"':
+                field.type = NDJSON_STRING;
+                field.raw = p + 1;
+                value_end = string_end(p + 1, end, &field.has_escapes);
+                if (!value_end) return -1;
+                field.raw_len = (size_t)(value_end - field.raw);
+                value_end++;
+                break;
+            case '[':
+            case '{':
+                field.type = *p == '[' ? NDJSON_ARRAY : NDJSON_OBJECT;
+                field.raw = p;
+                value_end = skip_container(p, end);
+                if (!value_end) return -1;
+                field.raw_len = (size_t)(value_end - p);
+                break;
+            default:
+                field.type = (*p == 't' || *p == 'f') ? NDJSON_BOOL : *p == 'n' ? NDJSON_NULL : NDJSON_NUMBER;
+                field.raw = p;
+                value_end = p;
+                while (value_end < end && *value_end != ',' && *value_end != '}' &&
+                       *value_end != ' ' && *value_end != '\t' && *value_end != '\r') {
+                    value_end++;
+                }
+                field.raw_len = (size_t)(value_end - p);
+                break;
+        }
+        
+        if (on_field(&field, ctx) < 0) return -1;
+        
+        p = skip_space(value_end, end);
+        if (p >= end) return -1;
+        if (*p == '}') return 0;
+        if (*p != ',') return -1;
+        p = skip_space(p + 1, end);
+    }
+    return -1;
+}
+
+static size_t put_utf8(char* out, uint32_t cp) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+static int hex4(const char* p, const char* end, uint32_t* out) {
+    if (end - p < 4) return -1;
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= (uint32_t)(c - '0');
+        else if (c >= 'a' && c <= 'f') value |= (uint32_t)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') value |= (uint32_t)(c - 'A' + 10);
+        else return -1;
+    }
+    *out = value;
+    return 0;
+}
+
+/* Decodes JSON escapes into out, which needs raw_len bytes; returns the length. */
+size_t ndjson_decode_string(const char* raw, size_t raw_len, char* out) {
+    const char* p = raw;
+    const char* end = raw + raw_len;
+    size_t n = 0;
+    
+    while (p < end) {
+        const char* next = scan_string(p, end);
+        memcpy(out + n, p, (size_t)(next - p));
+        n += (size_t)(next - p);
+        p = next;
+        if (p >= end) break;
+        if (*p != '\\' || p + 1 >= end) {
+            out[n++] = *p++;
+            continue;
+        }
+        
+        char c = p[1];
+        p += 2;
+        switch (c) {
+            case 'n': out[n++] = '\n'; break;
+            case 't': out[n++] = '\t'; break;
+            case 'r': out[n++] = '\r'; break;
+            case 'b': out[n++] = '\b'; break;
+            case 'f': out[n++] = '\f'; break;
+            case 'u': {
+                uint32_t cp;
+                if (hex4(p, end, &cp) < 0) break;
+                p += 4;
+                if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    uint32_t low;
+                    if (hex4(p + 2, end, &low) == 0 && low >= 0xDC00 && low < 0xE000) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    }
+                }
+                n += put_utf8(out + n, cp);
+                break;
+            }
+            default: out[n++] = c; break;
+        }
+    }
+    return n;
+}
+
+/*
+ * Streams a file through a growing read buffer and hands every non-empty
+ * line to on_line, whatever its length. Returns the number of lines or -1.
+ */
+int ndjson_read_file(const char* path, ndjson_line_fn on_line, void* ctx, size_t* bytes_read) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    
+    size_t cap = NDJSON_READ_CHUNK;
+    char* buf = malloc(cap);
+    if (!buf) {
+        close(fd);
+        return -1;
+    }
+    
+    size_t len = 0;
+    size_t total = 0;
+    int lines = 0;
+    int eof = 0;
+    int rc = 0;
+    
+    while (!eof) {
+        if (cap - len < NDJSON_READ_CHUNK / 2) {
+            char* grown = realloc(buf, cap * 2);
+            if (!grown) {
+                rc = -1;
+                break;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+        
+        ssize_t n = read(fd, buf + len, cap - len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            rc = -1;
+            break;
+        }
+        if (n == 0) eof = 1;
+        len += (size_t)n;
+        total += (size_t)n;
+        
+        char* start = buf;
+        char* end = buf + len;
+        while (start < end) {
+            char* nl = memchr(start, '\n', (size_t)(end - start));
+            if (!nl) {
+                if (!eof) break;
+                nl = end;
+            }
+            size_t line_len = (size_t)(nl - start);
+            if (line_len && start[line_len - 1] == '\r') line_len--;
+            if (line_len) {
+                if (on_line(start, line_len, ctx) < 0) {
+                    rc = -1;
+                    break;
+                }
+                lines++;
+            }
+            start = nl + 1;
+        }
+        if (rc < 0) break;
+        
+        /* Keep the partial tail line; the buffer grows if it never ends. */
+        len = start < end ? (size_t)(end - start) : 0;
+        if (len) memmove(buf, start, len);
+    }
+    
+    free(buf);
+    close(fd);
+    if (bytes_read) *bytes_read = total;
+    return rc < 0 ? -1 : lines;
+}
@@ -0,0 +1,46 @@
+#ifndef NDJSON_H
+#define NDJSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define NDJSON_READ_CHUNK (1 << 20)
+
+typedef enum {
+    NDJSON_STRING = 0,
+    NDJSON_NUMBER = 1,
+    NDJSON_BOOL = 2,
+    NDJSON_NULL = 3,
+    NDJSON_ARRAY = 4,
+    NDJSON_OBJECT = 5
+} NdjsonType;
+
+/*
+ * One top-level member of a record. raw/raw_len span the value exactly as it
+ * appears in the line (strings without their quotes, escapes intact);
+ * has_escapes tells the caller whether ndjson_decode_string is needed.
+ */
+typedef struct {
+    const char* key;
+    size_t key_len;
+    NdjsonType type;
+    const char* raw;
+    size_t raw_len;
+    uint8_t has_escapes;
+} NdjsonField;
+
+typedef int (*ndjson_field_fn)(const NdjsonField* field, void* ctx);
+typedef int (*ndjson_line_fn)(const char* line, size_t len, void* ctx);
+
+int ndjson_read_file(const char* path, ndjson_line_fn on_line, void* ctx, size_t* bytes_read);
+int ndjson_parse_object(const char* line, size_t len, ndjson_field_fn on_field, void* ctx);
+size_t ndjson_decode_string(const char* raw, size_t raw_len, char* out);
+
+/* Inline so the key length of a literal folds to a constant. */
+static inline int ndjson_key_is(const NdjsonField* field, const char* key) {
+    size_t len = strlen(key);
+    return field->key_len == len && memcmp(field->key, key, len) == 0;
+}
+
+#endif
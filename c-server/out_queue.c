@@ -0,0 +1,206 @@
+#include "out_queue.h"
+#include "memory_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+
+#define OUTQ_POOL_SLAB 1024
+
+/*
+ * Reference and file segments are bare headers; copy segments carry
+ * OUTQ_COPY_CHUNK bytes unless one write needs more, which is malloc'd.
+ */
+static MemoryPool* segment_pool = NULL;
+static MemoryPool* chunk_pool = NULL;
+
+int outq_init(void) {
+    segment_pool = pool_create("out-segments", sizeof(OutSegment), OUTQ_POOL_SLAB, POOL_GROW);
+    chunk_pool = pool_create("out-chunks", sizeof(OutSegment) + OUTQ_COPY_CHUNK, OUTQ_POOL_SLAB, POOL_GROW);
+    return segment_pool && chunk_pool ? 0 : -1;
+}
+
+/* After every queue is cleared. */
+void outq_shutdown(void) {
+    pool_destroy(segment_pool);
+    pool_destroy(chunk_pool);
+    segment_pool = chunk_pool = NULL;
+}
+
+static OutSegment* segment_alloc(size_t capacity) {
+    MemoryPool* pool = capacity == 0 ? segment_pool : capacity == OUTQ_COPY_CHUNK ? chunk_pool : NULL;
+    OutSegment* seg = pool ? pool_alloc(pool) : NULL;
+    int pooled = seg != NULL;
+    if (!seg) seg = malloc(sizeof(OutSegment) + capacity);
+    if (!seg) return NULL;
+    memset(seg, 0, sizeof(OutSegment));
+    seg->pooled = (uint8_t)pooled;
+    seg->capacity = capacity;
+    seg->file_fd = -1;
+    return seg;
+}
+
+static void segment_append(OutQueue* q, OutSegment* seg) {
+    seg->next = NULL;
+    if (q->tail) q->tail->next = seg;
+    else q->head = seg;
+    q->tail = seg;
+}
+
+static void segment_free(OutSegment* seg) {
+    if (seg->kind == OUTQ_REF && seg->release) seg->release(seg->owner);
+    if (seg->kind == OUTQ_FILE && seg->file_fd >= 0) close(seg->file_fd);
+    if (!seg->pooled) free(seg);
+    else pool_free(seg->capacity ? chunk_pool : segment_pool, seg);
+}
+
+static void segment_pop(OutQueue* q) {
+    OutSegment* seg = q->head;
+    q->head = seg->next;
+    if (!q->head) q->tail = NULL;
+    segment_free(seg);
+}
+
+int outq_push_copy(OutQueue* q, const void* data, size_t len) {
+    if (len == 0) return 0;
+    
+    /* Small writes (headers, JSON bodies) coalesce into the tail segment. */
+    OutSegment* tail = q->tail;
+    if (tail && tail->kind == OUTQ_COPY && tail->capacity - tail->len >= len) {
+        memcpy(tail->storage + tail->len, data, len);
+        tail->len += len;
+        q->bytes += len;
+        return 0;
+    }
+    
+    size_t capacity = len > OUTQ_COPY_CHUNK ? len : OUTQ_COPY_CHUNK;
+    OutSegment* seg = segment_alloc(capacity);
+    if (!seg) return -1;
+    seg->kind = OUTQ_COPY;
+    seg->data = seg->storage;
+    memcpy(seg->storage, data, len);
+    seg->len = len;
+    segment_append(q, seg);
+    q->bytes += len;
+    return 0;
+}
+
+/*
+ * Room for at least min bytes at the end of the queue, for callers that
+ * encode straight into it: the tail's free space when it is enough, else a
+ * fresh segment. *avail is how much may be written; nothing counts as
+ * queued until outq_commit.
+ */
+char* outq_reserve(OutQueue* q, size_t min, size_t* avail) {
+    OutSegment* tail = q->tail;
+    if (!tail || tail->kind != OUTQ_COPY || tail->capacity - tail->len < min) {
+        OutSegment* seg = segment_alloc(min > OUTQ_COPY_CHUNK ? min : OUTQ_COPY_CHUNK);
+        if (!seg) return NULL;
+        seg->kind = OUTQ_COPY;
+        seg->data = seg->storage;
+        segment_append(q, seg);
+        tail = seg;
+    }
+    *avail = tail->capacity - tail->len;
+    return tail->storage + tail->len;
+}
+
+/* Queues len bytes written at the last outq_reserve. */
+void outq_commit(OutQueue* q, size_t len) {
+    q->tail->len += len;
+    q->bytes += len;
+}
+
+int outq_push_ref(OutQueue* q, const void* data, size_t len, void (*release)(void*), void* owner) {
+    OutSegment* seg = segment_alloc(0);
+    if (!seg) {
+        if (release) release(owner);
+        return -1;
+    }
+    seg->kind = OUTQ_REF;
+    seg->data = data;
+    seg->len = len;
+    seg->release = release;
+    seg->owner = owner;
+    segment_append(q, seg);
+    q->bytes += len;
+    return 0;
+}
+
+int outq_push_file(OutQueue* q, int fd, off_t offset, off_t end) {
+    OutSegment* seg = segment_alloc(0);
+    if (!seg) {
+        close(fd);
+        return -1;
+    }
+    seg->kind = OUTQ_FILE;
+    seg->file_fd = fd;
+    seg->file_off = offset;
+    seg->file_end = end;
+    segment_append(q, seg);
+    q->bytes += (size_t)(end - offset);
+    return 0;
+}
+
+/*
+ * Writes as much as the socket takes. Consecutive memory segments go out in
+ * one writev(), file ranges through sendfile(). Returns 1 once the queue is
+ * empty, 0 when the socket is full (resume on EPOLLOUT) and -1 on error.
+ */
+int outq_flush(OutQueue* q, int sock_fd) {
+    while (q->head) {
+        OutSegment* seg = q->head;
+        
+        if (seg->kind == OUTQ_FILE) {
+            if (seg->file_off >= seg->file_end) {
+                segment_pop(q);
+                continue;
+            }
+            ssize_t n = sendfile(sock_fd, seg->file_fd, &seg->file_off, seg->file_end - seg->file_off);
+            if (n > 0) {
+                q->bytes -= (size_t)n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+            return -1;
+        }
+        
+        struct iovec iov[OUTQ_MAX_IOV];
+        int iovcnt = 0;
+        for (OutSegment* s = seg; s && s->kind != OUTQ_FILE && iovcnt < OUTQ_MAX_IOV; s = s->next) {
+            if (s->pos == s->len) continue;
+            iov[iovcnt].iov_base = (void*)(s->data + s->pos);
+            iov[iovcnt].iov_len = s->len - s->pos;
+            iovcnt++;
+        }
+        
+        ssize_t n = iovcnt ? writev(sock_fd, iov, iovcnt) : 0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        
+        size_t written = (size_t)n;
+        q->bytes -= written;
+        while (q->head && q->head->kind != OUTQ_FILE) {
+            OutSegment* s = q->head;
+            size_t left = s->len - s->pos;
+            if (written < left) {
+                s->pos += written;
+                break;
+            }
+            written -= left;
+            segment_pop(q);
+        }
+    }
+    return 1;
+}
+
+void outq_clear(OutQueue* q) {
+    while (q->head) segment_pop(q);
+    q->bytes = 0;
+}
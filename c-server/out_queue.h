@@ -0,0 +1,58 @@
+#ifndef OUT_QUEUE_H
+#define OUT_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define OUTQ_COPY_CHUNK 4096
+#define OUTQ_MAX_IOV 64
+
+typedef enum {
+    OUTQ_COPY = 0,
+    OUTQ_REF = 1,
+    OUTQ_FILE = 2
+} OutSegmentKind;
+
+typedef struct OutSegment {
+    struct OutSegment* next;
+    uint8_t kind;
+    uint8_t pooled;
+    const char* data;
+    size_t len;
+    size_t pos;
+    size_t capacity;
+    void (*release)(void* owner);
+    void* owner;
+    int file_fd;
+    off_t file_off;
+    off_t file_end;
+    char storage[];
+} OutSegment;
+
+/*
+ * Ordered per-connection output: copied bytes, borrowed refcounted buffers
+ * and file ranges, flushed with writev()/sendfile() as the socket allows.
+ */
+typedef struct {
+    OutSegment* head;
+    OutSegment* tail;
+    size_t bytes;
+} OutQueue;
+
+int outq_init(void);
+void outq_shutdown(void);
+
+int outq_push_copy(OutQueue* q, const void* data, size_t len);
+char* outq_reserve(OutQueue* q, size_t min, size_t* avail);
+void outq_commit(OutQueue* q, size_t len);
+int outq_push_ref(OutQueue* q, const void* data, size_t len, void (*release)(void*), void* owner);
+int outq_push_file(OutQueue* q, int fd, off_t offset, off_t end);
+int outq_flush(OutQueue* q, int sock_fd);
+void outq_clear(OutQueue* q);
+
+static inline int outq_pending(const OutQueue* q) {
+    return q->head != NULL;
+}
+
+#endif
@@ -0,0 +1,222 @@
+#include "router.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct RouteNode {
+    char* prefix;                  /* literal text on the edge into this node */
+    size_t prefix_len;
+    char* param_name;              /* set on ":name" nodes, which have no prefix */
+    RouteNode** children;          /* literal children, each with a distinct first byte */
+    int child_count;
+    RouteNode* param;
+    int routes[ROUTE_METHODS];
+    uint32_t methods;
+};
+
+static RouteNode* node_new(const char* prefix, size_t len) {
+    RouteNode* node = calloc(1, sizeof(RouteNode));
+    if (!node) return NULL;
+    node->prefix = strndup(prefix, len);
+    if (!node->prefix) {
+        free(node);
+        return NULL;
+    }
+    node->prefix_len = len;
+    for (int i = 0; i < ROUTE_METHODS; i++) node->routes[i] = -1;
+    return node;
+}
+
+static void node_free(RouteNode* node) {
+    if (!node) return;
+    for (int i = 0; i < node->child_count; i++) node_free(node->children[i]);
+    node_free(node->param);
+    free(node->children);
+    free(node->prefix);
+    free(node->param_name);
+    free(node);
+}
+
+static RouteNode* child_for(const RouteNode* node, char first) {
+    for (int i = 0; i < node->child_count; i++) {
+        if (node->children[i]->prefix[0] == first) return node->children[i];
+    }
+    return NULL;
+}
+
+static int child_add(RouteNode* node, RouteNode* child) {
+    RouteNode** grown = realloc(node->children, sizeof(RouteNode*) * (size_t)(node->child_count + 1));
+    if (!grown) return -1;
+    node->children = grown;
+    node->children[node->child_count++] = child;
+    return 0;
+}
+
+/* Cuts node's edge at offset at; everything below moves to a new child holding the rest. */
+static int node_split(RouteNode* node, size_t at) {
+    RouteNode* rest = node_new(node->prefix + at, node->prefix_len - at);
+    if (!rest) return -1;
+    rest->children = node->children;
+    rest->child_count = node->child_count;
+    rest->param = node->param;
+    rest->methods = node->methods;
+    memcpy(rest->routes, node->routes, sizeof(rest->routes));
+    
+    node->children = NULL;
+    node->child_count = 0;
+    node->param = NULL;
+    node->methods = 0;
+    for (int i = 0; i < ROUTE_METHODS; i++) node->routes[i] = -1;
+    node->prefix_len = at;
+    node->prefix[at] = '\0';
+    return child_add(node, rest);
+}
+
+int router_init(Router* router) {
+    router->root = node_new("", 0);
+    return router->root ? 0 : -1;
+}
+
+void router_free(Router* router) {
+    node_free(router->root);
+    router->root = NULL;
+}
+
+int router_add(Router* router, const char* pattern, uint32_t methods, int route) {
+    RouteNode* node = router->root;
+    const char* at = pattern;
+    while (*at) {
+        if (*at == ':') {
+            size_t name_len = strcspn(at + 1, "/");
+            if (!node->param) {
+                node->param = node_new("", 0);
+                if (!node->param || !(node->param->param_name = strndup(at + 1, name_len))) return -1;
+            } else if (strlen(node->param->param_name) != name_len ||
+                       strncmp(node->param->param_name, at + 1, name_len) != 0) {
+                fprintf(stderr, "Route %s: parameter clashes with :%s\n", pattern, node->param->param_name);
+                return -1;
+            }
+            node = node->param;
+            at += 1 + name_len;
+            continue;
+        }
+        
+        size_t run = strcspn(at, ":");
+        RouteNode* child = child_for(node, *at);
+        if (!child) {
+            child = node_new(at, run);
+            if (!child || child_add(node, child) < 0) return -1;
+            node = child;
+            at += run;
+            continue;
+        }
+        size_t common = 0;
+        while (common < run && common < child->prefix_len && child->prefix[common] == at[common]) common++;
+        if (common < child->prefix_len && node_split(child, common) < 0) return -1;
+        node = child;
+        at += common;
+    }
+    
+    for (int i = 0; i < ROUTE_METHODS; i++) {
+        if (!(methods & (1u << i))) continue;
+        if (node->routes[i] >= 0) {
+            fprintf(stderr, "Route %s registered twice\n", pattern);
+            return -1;
+        }
+        node->routes[i] = route;
+    }
+    node->methods |= methods;
+    return 0;
+}
+
+static const RouteNode* match_node(const RouteNode* node, const char* path, const char* end, RouteMatch* match) {
+    if (path == end) return node->methods ? node : NULL;
+    
+    RouteNode* child = child_for(node, *path);
+    if (child && child->prefix_len <= (size_t)(end - path) && memcmp(child->prefix, path, child->prefix_len) == 0) {
+        const RouteNode* found = match_node(child, path + child->prefix_len, end, match);
+        if (found) return found;
+    }
+    
+    if (node->param && match->param_count < ROUTE_MAX_PARAMS) {
+        size_t len = 0;
+        while (path + len < end && path[len] != '/') len++;
+        if (len == 0) return NULL;
+        RouteParam* param = &match->params[match->param_count++];
+        param->name = node->param->param_name;
+        param->name_len = strlen(param->name);
+        param->value = path;
+        param->len = len;
+        const RouteNode* found = match_node(node->param, path + len, end, match);
+        if (found) return found;
+        match->param_count--;
+    }
+    return NULL;
+}
+
+/* target is a request path with an optional ?query. Returns ROUTE_FOUND, ROUTE_NOT_FOUND or ROUTE_BAD_METHOD. */
+int router_match(const Router* router, const char* target, uint32_t method, RouteMatch* match) {
+    const char* end = strchr(target, '?');
+    match->route = -1;
+    match->methods = 0;
+    match->path = target;
+    match->query = end ? end + 1 : "";
+    match->param_count = 0;
+    if (!end) end = target + strlen(target);
+    
+    const RouteNode* node = match_node(router->root, target, end, match);
+    if (!node) return ROUTE_NOT_FOUND;
+    match->methods = node->methods;
+    for (int i = 0; i < ROUTE_METHODS; i++) {
+        if ((method & (1u << i)) && node->routes[i] >= 0) {
+            match->route = node->routes[i];
+            return ROUTE_FOUND;
+        }
+    }
+    return ROUTE_BAD_METHOD;
+}
+
+uint32_t router_method(const char* method, size_t len) {
+    if (len == 3 && memcmp(method, "GET", 3) == 0) return ROUTE_GET;
+    if (len == 4 && memcmp(method, "HEAD", 4) == 0) return ROUTE_HEAD;
+    if (len == 4 && memcmp(method, "POST", 4) == 0) return ROUTE_POST;
+    return 0;
+}
+
+const char* route_param(const RouteMatch* match, const char* name, size_t* len) {
+    size_t name_len = strlen(name);
+    for (int i = 0; i < match->param_count; i++) {
+        const RouteParam* param = &match->params[i];
+        if (param->name_len == name_len && memcmp(param->name, name, name_len) == 0) {
+            if (len) *len = param->len;
+            return param->value;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Value of name in a query string (name=value, or a bare name for ""),
+ * not percent-decoded. Shared by everything that reads a query, so HTTP
+ * routes and WebSocket upgrades agree on what a parameter is.
+ */
+const char* query_param(const char* query, const char* name, size_t* len) {
+    size_t name_len = strlen(name);
+    const char* at = query ? query : "";
+    while (*at) {
+        size_t field = strcspn(at, "&");
+        if (field >= name_len && strncmp(at, name, name_len) == 0 &&
+            (at[name_len] == '=' || name_len == field)) {
+            const char* value = at + name_len + (at[name_len] == '=');
+            if (len) *len = (size_t)(at + field - value);
+            return value;
+        }
+        at += field;
+        if (*at == '&') at++;
+    }
+    return NULL;
+}
+
+const char* route_query(const RouteMatch* match, const char* name, size_t* len) {
+    return query_param(match->query, name, len);
+}
@@ -0,0 +1,63 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ROUTE_GET (1u << 0)
+#define ROUTE_HEAD (1u << 1)
+#define ROUTE_POST (1u << 2)
+#define ROUTE_METHODS 3
+#define ROUTE_MAX_PARAMS 4
+
+#define ROUTE_FOUND 0
+#define ROUTE_NOT_FOUND -1
+#define ROUTE_BAD_METHOD -2
+
+typedef struct {
+    const char* name;
+    size_t name_len;
+    const char* value;
+    size_t len;
+} RouteParam;
+
+/*
+ * Result of a lookup. Parameter values and query point into the target
+ * that was matched, which must outlive the match; query is what follows
+ * '?', or "" when there is none. methods is every method the path
+ * accepts, also filled in for ROUTE_BAD_METHOD.
+ */
+typedef struct {
+    int route;
+    uint32_t methods;
+    const char* path;
+    const char* query;
+    int param_count;
+    RouteParam params[ROUTE_MAX_PARAMS];
+} RouteMatch;
+
+typedef struct RouteNode RouteNode;
+
+/*
+ * Radix trie over request paths, built once at startup and read-only
+ * afterwards, so any number of workers can match against it. Patterns are
+ * literal text plus ":name" segments that match one path segment, e.g.
+ * "/api/chunk/:n". Literal edges win over parameters, and a lookup costs
+ * one pass over the path plus backtracking where a literal and a
+ * parameter both fit. route is the caller's own id for the pattern.
+ */
+typedef struct {
+    RouteNode* root;
+} Router;
+
+int router_init(Router* router);
+void router_free(Router* router);
+int router_add(Router* router, const char* pattern, uint32_t methods, int route);
+int router_match(const Router* router, const char* target, uint32_t method, RouteMatch* match);
+
+uint32_t router_method(const char* method, size_t len);
+const char* route_param(const RouteMatch* match, const char* name, size_t* len);
+const char* route_query(const RouteMatch* match, const char* name, size_t* len);
+const char* query_param(const char* query, const char* name, size_t* len);
+
+#endif
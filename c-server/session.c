@@ -0,0 +1,401 @@
+#include "session.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+static uint32_t hash_id(const char* id, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)id[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int session_id_valid(const char* id, size_t len) {
+    if (len == 0 || len >= SESSION_ID_MAX) return 0;
+    for (size_t i = 0; i < len; i++) {
+        if (!isalnum((unsigned char)id[i]) && id[i] != '-' && id[i] != '_' && id[i] != '.') return 0;
+    }
+    return 1;
+}
+
+static PlaybackSession* bucket_find(SessionTable* table, const char* id, size_t len, uint32_t hash) {
+    PlaybackSession* session = table->buckets[hash % SESSION_BUCKETS];
+    while (session) {
+        if (strncmp(session->id, id, len) == 0 && session->id[len] == '\0') return session;
+        session = session->hash_next;
+    }
+    return NULL;
+}
+
+static PlaybackSession* session_create(SessionTable* table, const char* id, size_t len) {
+    PlaybackSession* session = calloc(1, sizeof(PlaybackSession));
+    if (!session) return NULL;
+    memcpy(session->id, id, len);
+    atomic_init(&session->refs, 1);
+    atomic_init(&session->position, CANON_POSITION(atomic_load(&table->generation), 0));
+    atomic_init(&session->playing, 0);
+    atomic_init(&session->speed, 1.0f);
+    session->last_position = atomic_load(&session->position);
+    session->applied_speed = 1.0f;
+    return session;
+}
+
+int session_table_init(SessionTable* table, uint32_t generation, uint64_t frame_ns, uint32_t tick_ms,
+                       SessionChunkFn on_chunk, void* chunk_arg) {
+    memset(table, 0, sizeof(*table));
+    pthread_rwlock_init(&table->lock, NULL);
+    atomic_init(&table->pending, NULL);
+    atomic_init(&table->generation, generation);
+    table->frame_ns = frame_ns;
+    table->tick_ms = tick_ms;
+    table->on_chunk = on_chunk;
+    table->chunk_arg = chunk_arg;
+    
+    PlaybackSession* fallback = session_get(table, SESSION_DEFAULT, strlen(SESSION_DEFAULT), 1);
+    if (!fallback) return -1;
+    session_release(fallback);
+    return 0;
+}
+
+/* Returns the session with a reference held, creating it when asked to. */
+PlaybackSession* session_get(SessionTable* table, const char* id, size_t len, int create) {
+    if (!session_id_valid(id, len)) return NULL;
+    uint32_t hash = hash_id(id, len);
+    
+    pthread_rwlock_rdlock(&table->lock);
+    PlaybackSession* session = bucket_find(table, id, len, hash);
+    if (session) atomic_fetch_add(&session->refs, 1);
+    pthread_rwlock_unlock(&table->lock);
+    if (session || !create) return session;
+    
+    pthread_rwlock_wrlock(&table->lock);
+    session = bucket_find(table, id, len, hash);
+    if (!session && table->count < SESSION_MAX) {
+        session = session_create(table, id, len);
+        if (session) {
+            PlaybackSession** bucket = &table->buckets[hash % SESSION_BUCKETS];
+            session->hash_next = *bucket;
+            *bucket = session;
+            table->count++;
+        }
+    }
+    if (session) atomic_fetch_add(&session->refs, 1);
+    pthread_rwlock_unlock(&table->lock);
+    return session;
+}
+
+void session_release(PlaybackSession* session) {
+    if (!session) return;
+    if (atomic_fetch_sub(&session->refs, 1) == 1) {
+        free(session);
+    }
+}
+
+/* Hands the session to the player; it re-reads the controls on its next frame. */
+static void session_queue(SessionTable* table, PlaybackSession* session) {
+    if (atomic_exchange(&session->queued, 1)) return;
+    atomic_fetch_add(&session->refs, 1);
+    PlaybackSession* head = atomic_load(&table->pending);
+    do {
+        session->pending_next = head;
+    } while (!atomic_compare_exchange_weak(&table->pending, &head, session));
+}
+
+int session_remove(SessionTable* table, const char* id, size_t len) {
+    if (len == strlen(SESSION_DEFAULT) && strncmp(id, SESSION_DEFAULT, len) == 0) return -1;
+    if (!session_id_valid(id, len)) return -1;
+    uint32_t hash = hash_id(id, len);
+    
+    pthread_rwlock_wrlock(&table->lock);
+    PlaybackSession** link = &table->buckets[hash % SESSION_BUCKETS];
+    while (*link && !(strncmp((*link)->id, id, len) == 0 && (*link)->id[len] == '\0')) {
+        link = &(*link)->hash_next;
+    }
+    PlaybackSession* session = *link;
+    if (session) {
+        *link = session->hash_next;
+        table->count--;
+    }
+    pthread_rwlock_unlock(&table->lock);
+    if (!session) return -1;
+    
+    atomic_store(&session->removed, 1);
+    session_queue(table, session);
+    session_release(session);
+    return 0;
+}
+
+/* Writes the ids as a JSON string list; stops early when out is full. */
+size_t session_list(SessionTable* table, char* out, size_t cap, size_t* total) {
+    size_t len = 0;
+    pthread_rwlock_rdlock(&table->lock);
+    *total = table->count;
+    for (size_t b = 0; b < SESSION_BUCKETS; b++) {
+        for (PlaybackSession* session = table->buckets[b]; session; session = session->hash_next) {
+            size_t need = strlen(session->id) + 3;
+            if (len + need >= cap) goto done;
+            len += (size_t)snprintf(out + len, cap - len, "%s\"%s\"", len ? "," : "", session->id);
+        }
+    }
+done:
+    pthread_rwlock_unlock(&table->lock);
+    if (cap) out[len < cap ? len : cap - 1] = '\0';
+    return len;
+}
+
+void session_play(SessionTable* table, PlaybackSession* session, uint8_t playing) {
+    atomic_store(&session->playing, playing);
+    session_queue(table, session);
+}
+
+void session_seek(SessionTable* table, PlaybackSession* session, const CanonSnapshot* snap, float pos) {
+    size_t count = snap->store.count;
+    if (count == 0) return;
+    /* Clamped before scaling so the cast cannot overflow. */
+    uint32_t index = pos >= 1.0f ? (uint32_t)count - 1 : pos > 0 ? (uint32_t)(pos * count) : 0;
+    if (index >= count) index = count - 1;
+    atomic_store(&session->position, CANON_POSITION(snap->generation, index));
+    session_queue(table, session);
+}
+
+void session_stop(SessionTable* table, PlaybackSession* session, const CanonSnapshot* snap) {
+    atomic_store(&session->playing, 0);
+    atomic_store(&session->position, CANON_POSITION(snap->generation, 0));
+    session_queue(table, session);
+}
+
+/*
+ * Speeds are kept within 0 and SESSION_SPEED_MIN..SESSION_SPEED_MAX, so
+ * the frame arithmetic in session_process stays in range; 0, a negative
+ * or NaN speed holds the session still.
+ */
+void session_set_speed(SessionTable* table, PlaybackSession* session, float speed) {
+    if (!(speed > 0.0f)) speed = 0.0f;
+    else if (speed < SESSION_SPEED_MIN) speed = SESSION_SPEED_MIN;
+    else if (speed > SESSION_SPEED_MAX) speed = SESSION_SPEED_MAX;
+    atomic_store(&session->speed, speed);
+    session_queue(table, session);
+}
+
+static void wheel_unlink(SessionTable* table, PlaybackSession* session) {
+    if (session->wheel_prev) session->wheel_prev->wheel_next = session->wheel_next;
+    else table->wheel[session->slot] = session->wheel_next;
+    if (session->wheel_next) session->wheel_next->wheel_prev = session->wheel_prev;
+    session->wheel_prev = session->wheel_next = NULL;
+}
+
+static void wheel_link(SessionTable* table, PlaybackSession* session, uint32_t slot) {
+    session->slot = slot;
+    session->wheel_prev = NULL;
+    session->wheel_next = table->wheel[slot];
+    if (session->wheel_next) session->wheel_next->wheel_prev = session;
+    table->wheel[slot] = session;
+}
+
+/*
+ * Where a position written against another snapshot lands in latest: the
+ * chunk with the same timestamp when it was written against previous,
+ * otherwise the same index, clamped.
+ */
+static uint32_t rebased_index(uint64_t position, const CanonSnapshot* previous, const CanonSnapshot* latest) {
+    uint32_t index = CANON_POSITION_INDEX(position);
+    if (previous && CANON_POSITION_GENERATION(position) == (uint32_t)previous->generation &&
+        index < previous->store.count) {
+        return (uint32_t)canon_snapshot_find(latest, previous->store.timestamp[index]);
+    }
+    if (latest->store.count == 0) return 0;
+    return index < latest->store.count ? index : (uint32_t)latest->store.count - 1;
+}
+
+/*
+ * A seek or stop made with a snapshot acquired before the last rebase
+ * stores a position the rebase has already walked past; move it onto snap
+ * so it keeps playing instead of stalling on the old generation.
+ */
+static void session_adopt(PlaybackSession* session, const CanonSnapshot* snap) {
+    uint32_t generation = (uint32_t)snap->generation;
+    uint64_t position = atomic_load(&session->position);
+    /* Newer ones are left for the rebase that is about to catch up with them. */
+    while ((int32_t)(CANON_POSITION_GENERATION(position) - generation) < 0) {
+        uint64_t rebased = CANON_POSITION(generation, rebased_index(position, NULL, snap));
+        if (atomic_compare_exchange_weak(&session->position, &position, rebased)) break;
+    }
+}
+
+/* Brings the position up to now at the speed the session has been playing at. */
+static void session_settle(SessionTable* table, PlaybackSession* session,
+                           const CanonSnapshot* snap, uint64_t now_ns) {
+    const CanonStore* store = &snap->store;
+    uint32_t generation = (uint32_t)snap->generation;
+    uint64_t elapsed = now_ns - session->updated_ns;
+    session->updated_ns = now_ns;
+    
+    uint64_t position = atomic_load(&session->position);
+    if (position != session->last_position) {
+        /* Someone else moved it (seek, stop, rebase): start that chunk afresh. */
+        session->phase = 0.0;
+        session->last_position = position;
+        return;
+    }
+    if (!session->scheduled || session->applied_speed <= 0.0f || store->count == 0 ||
+        CANON_POSITION_GENERATION(position) != generation) {
+        return;
+    }
+    
+    session->phase += (double)elapsed * session->applied_speed / (table->tick_ms * 1e6);
+    if (session->phase < 1.0) return;
+    uint64_t steps = (uint64_t)session->phase;
+    session->phase -= (double)steps;
+    uint32_t index = (uint32_t)((CANON_POSITION_INDEX(position) + steps) % store->count);
+    
+    /* A seek or stop that lands first wins; its queue entry brings it back. */
+    uint64_t advanced = CANON_POSITION(generation, index);
+    if (!atomic_compare_exchange_strong(&session->position, &position, advanced)) {
+        session->phase = 0.0;
+        session->last_position = position;
+        return;
+    }
+    session->last_position = advanced;
+    if (index != session->last_index) {
+        session->last_index = index;
+        if (table->on_chunk) table->on_chunk(session, store, index, table->chunk_arg);
+    }
+}
+
+/*
+ * Settles a session that is not linked into the wheel and links it again at
+ * the frame its next chunk is due, or drops it from the wheel when it is no
+ * longer playing. The wheel holds a reference while a session is scheduled.
+ */
+static void session_process(SessionTable* table, PlaybackSession* session,
+                            const CanonSnapshot* snap, uint64_t now_ns) {
+    uint8_t was_scheduled = session->scheduled;
+    session_adopt(session, snap);
+    session_settle(table, session, snap, now_ns);
+    
+    uint8_t playing = atomic_load(&session->playing);
+    float speed = atomic_load(&session->speed);
+    session->applied_speed = speed;
+    if (atomic_load(&session->removed) || !playing || !(speed > 0.0f) || snap->store.count == 0) {
+        session->scheduled = 0;
+        if (was_scheduled) session_release(session);
+        return;
+    }
+    
+    double remaining_ns = (1.0 - session->phase) * table->tick_ms * 1e6 / speed;
+    uint64_t due = table->frame + (uint64_t)(remaining_ns / (double)table->frame_ns) + 1;
+    session->rounds = (uint32_t)((due - table->frame - 1) / SESSION_WHEEL_SLOTS);
+    wheel_link(table, session, (uint32_t)(due % SESSION_WHEEL_SLOTS));
+    session->scheduled = 1;
+    if (!was_scheduled) atomic_fetch_add(&session->refs, 1);
+}
+
+/*
+ * Control changes are announced right away rather than at the next chunk,
+ * so a pause or seek reaches listeners (and the event log that late
+ * joiners replay from) even when the session stops moving.
+ */
+static void session_announce(SessionTable* table, PlaybackSession* session, const CanonSnapshot* snap) {
+    const CanonStore* store = &snap->store;
+    uint64_t position = atomic_load(&session->position);
+    if (!table->on_chunk || atomic_load(&session->removed) || store->count == 0 ||
+        CANON_POSITION_GENERATION(position) != (uint32_t)snap->generation) {
+        return;
+    }
+    uint32_t index = CANON_POSITION_INDEX(position);
+    if (index >= store->count) return;
+    session->last_index = index;
+    table->on_chunk(session, store, index, table->chunk_arg);
+}
+
+static void drain_pending(SessionTable* table, const CanonSnapshot* snap, uint64_t now_ns) {
+    PlaybackSession* session = atomic_exchange(&table->pending, NULL);
+    while (session) {
+        PlaybackSession* next = session->pending_next;
+        atomic_store(&session->queued, 0);
+        if (session->scheduled) wheel_unlink(table, session);
+        session_process(table, session, snap, now_ns);
+        session_announce(table, session, snap);
+        session_release(session);
+        session = next;
+    }
+}
+
+static void visit_slot(SessionTable* table, uint32_t slot, const CanonSnapshot* snap, uint64_t now_ns) {
+    PlaybackSession* session = table->wheel[slot];
+    table->wheel[slot] = NULL;
+    while (session) {
+        PlaybackSession* next = session->wheel_next;
+        session->wheel_prev = session->wheel_next = NULL;
+        if (session->rounds > 0) {
+            session->rounds--;
+            wheel_link(table, session, slot);
+        } else {
+            session_process(table, session, snap, now_ns);
+        }
+        session = next;
+    }
+}
+
+/*
+ * Player thread: applies queued control changes, then walks the slots of
+ * the frames that elapsed. After a long stall every slot is visited once;
+ * positions stay exact because they are settled from the clock.
+ */
+void session_table_advance(SessionTable* table, const CanonSnapshot* snap, uint64_t frames, uint64_t now_ns) {
+    drain_pending(table, snap, now_ns);
+    uint64_t visits = frames < SESSION_WHEEL_SLOTS ? frames : SESSION_WHEEL_SLOTS;
+    for (uint64_t i = 0; i < visits; i++) {
+        table->frame++;
+        visit_slot(table, (uint32_t)(table->frame % SESSION_WHEEL_SLOTS), snap, now_ns);
+    }
+    table->frame += frames - visits;
+}
+
+/* Player thread: moves every session onto new content at the same moment. */
+void session_table_rebase(SessionTable* table, const CanonSnapshot* previous, const CanonSnapshot* latest) {
+    uint32_t generation = (uint32_t)latest->generation;
+    atomic_store(&table->generation, generation);
+    
+    pthread_rwlock_rdlock(&table->lock);
+    for (size_t b = 0; b < SESSION_BUCKETS; b++) {
+        for (PlaybackSession* session = table->buckets[b]; session; session = session->hash_next) {
+            uint64_t position = atomic_load(&session->position);
+            if (CANON_POSITION_GENERATION(position) == generation) continue;
+            
+            uint64_t rebased = CANON_POSITION(generation, rebased_index(position, previous, latest));
+            if (atomic_compare_exchange_strong(&session->position, &position, rebased) &&
+                session->last_position == position) {
+                session->last_position = rebased;
+            }
+        }
+    }
+    pthread_rwlock_unlock(&table->lock);
+}
+
+void session_table_destroy(SessionTable* table) {
+    PlaybackSession* session = atomic_exchange(&table->pending, NULL);
+    while (session) {
+        PlaybackSession* next = session->pending_next;
+        session_release(session);
+        session = next;
+    }
+    for (uint32_t slot = 0; slot < SESSION_WHEEL_SLOTS; slot++) {
+        while ((session = table->wheel[slot])) {
+            wheel_unlink(table, session);
+            session->scheduled = 0;
+            session_release(session);
+        }
+    }
+    for (size_t b = 0; b < SESSION_BUCKETS; b++) {
+        while ((session = table->buckets[b])) {
+            table->buckets[b] = session->hash_next;
+            session_release(session);
+        }
+    }
+    table->count = 0;
+    pthread_rwlock_destroy(&table->lock);
+}
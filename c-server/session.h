@@ -0,0 +1,98 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "canon_snapshot.h"
+
+#define SESSION_ID_MAX 32
+#define SESSION_MAX 16384
+#define SESSION_BUCKETS 4096
+#define SESSION_WHEEL_SLOTS 512
+#define SESSION_DEFAULT "default"
+#define SESSION_SPEED_MIN 0.01f          /* slowest a playing session moves; less is raised to it */
+#define SESSION_SPEED_MAX 64.0f          /* fastest; more is lowered to it */
+
+#define CANON_POSITION(generation, index) (((uint64_t)(uint32_t)(generation) << 32) | (uint32_t)(index))
+#define CANON_POSITION_GENERATION(position) ((uint32_t)((position) >> 32))
+#define CANON_POSITION_INDEX(position) ((uint32_t)(position))
+
+/*
+ * One named playhead. The control fields are written lock-free by the API:
+ * position packs the snapshot generation into the high half and the chunk
+ * index into the low half, so an index always says which content it refers
+ * to and a seek, stop or advance is a single atomic store or CAS. Writers
+ * then queue the session for the player, which owns everything below the
+ * marker and is the only thread touching the timer wheel.
+ */
+typedef struct PlaybackSession {
+    char id[SESSION_ID_MAX];
+    atomic_int refs;
+    _Atomic uint64_t position;
+    _Atomic uint8_t playing;
+    _Atomic float speed;
+    _Atomic uint8_t queued;
+    _Atomic uint8_t removed;
+    struct PlaybackSession* hash_next;
+    struct PlaybackSession* pending_next;
+    
+    /* Player thread only. */
+    double phase;
+    float applied_speed;
+    uint8_t scheduled;
+    uint32_t slot;
+    uint32_t rounds;
+    uint32_t last_index;
+    uint16_t shown_matrix;
+    uint8_t shown;
+    uint64_t last_position;
+    uint64_t updated_ns;
+    struct PlaybackSession* wheel_prev;
+    struct PlaybackSession* wheel_next;
+} PlaybackSession;
+
+/* Called by the player for every chunk a session moves onto, and after each control change. */
+typedef void (*SessionChunkFn)(PlaybackSession* session, const CanonStore* store,
+                               uint32_t index, void* arg);
+
+/*
+ * All sessions, found by id through a hash table guarded by a rwlock (only
+ * create and delete take it for writing), plus a hashed timer wheel with
+ * SESSION_WHEEL_SLOTS frame slots. A playing session sits in the slot of
+ * the frame its next chunk is due, so each frame touches only the sessions
+ * that actually move, however many are alive.
+ */
+typedef struct {
+    PlaybackSession* buckets[SESSION_BUCKETS];
+    size_t count;
+    pthread_rwlock_t lock;
+    _Atomic(PlaybackSession*) pending;
+    PlaybackSession* wheel[SESSION_WHEEL_SLOTS];
+    uint64_t frame;
+    uint64_t frame_ns;
+    uint32_t tick_ms;
+    _Atomic uint32_t generation;
+    SessionChunkFn on_chunk;
+    void* chunk_arg;
+} SessionTable;
+
+int session_table_init(SessionTable* table, uint32_t generation, uint64_t frame_ns, uint32_t tick_ms,
+                       SessionChunkFn on_chunk, void* chunk_arg);
+void session_table_destroy(SessionTable* table);
+int session_id_valid(const char* id, size_t len);
+PlaybackSession* session_get(SessionTable* table, const char* id, size_t len, int create);
+void session_release(PlaybackSession* session);
+int session_remove(SessionTable* table, const char* id, size_t len);
+size_t session_list(SessionTable* table, char* out, size_t cap, size_t* total);
+
+void session_play(SessionTable* table, PlaybackSession* session, uint8_t playing);
+void session_seek(SessionTable* table, PlaybackSession* session, const CanonSnapshot* snap, float pos);
+void session_stop(SessionTable* table, PlaybackSession* session, const CanonSnapshot* snap);
+void session_set_speed(SessionTable* table, PlaybackSession* session, float speed);
+
+void session_table_rebase(SessionTable* table, const CanonSnapshot* previous, const CanonSnapshot* latest);
+void session_table_advance(SessionTable* table, const CanonSnapshot* snap, uint64_t frames, uint64_t now_ns);
+
+#endif
@@ -4,88 +4,82 @@
 #include <string.h>
 #include <unistd.h>
 
-#define MAX_CLIENTS 1000
-
-static int sse_clients[MAX_CLIENTS] = {0};
-
-int sse_init(SSEContext* sse) {
-    memset(sse_clients, 0, sizeof(sse_clients));
-    sse->client_count = 0;
-    pthread_mutex_init(&sse->mutex, NULL);
+int sse_init(SSEContext* sse, BroadcastRing* log) {
+    sse->log = log;
+    for (int i = 0; i < SSE_MAX_WAKERS; i++) {
+        sse->wake_fds[i] = -1;
+        atomic_init(&sse->wake_pending[i], 0);
+    }
+    sse->waker_count = 0;
+    atomic_init(&sse->clients, 0);
+    atomic_init(&sse->dropped, 0);
     return 0;
 }
 
+/* Reactors own and close their eventfds. */
 void sse_shutdown(SSEContext* sse) {
-    pthread_mutex_lock(&sse->mutex);
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (sse_clients[i] > 0) {
-            close(sse_clients[i]);
-            sse_clients[i] = 0;
-        }
-    }
-    sse->client_count = 0;
-    pthread_mutex_unlock(&sse->mutex);
-    pthread_mutex_destroy(&sse->mutex);
+    sse->waker_count = 0;
 }
 
-int sse_add_client(SSEContext* sse, int fd) {
-    pthread_mutex_lock(&sse->mutex);
-    if (sse->client_count >= MAX_CLIENTS) {
-        pthread_mutex_unlock(&sse->mutex);
-        return -1;
-    }
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (sse_clients[i] == 0) {
-            sse_clients[i] = fd;
-            sse->client_count++;
-            pthread_mutex_unlock(&sse->mutex);
-            return 0;
-        }
-    }
-    pthread_mutex_unlock(&sse->mutex);
-    return -1;
+/* Registers a reactor's eventfd before publishing starts; returns its index. */
+int sse_add_waker(SSEContext* sse, int event_fd) {
+    if (sse->waker_count >= SSE_MAX_WAKERS) return -1;
+    sse->wake_fds[sse->waker_count] = event_fd;
+    return sse->waker_count++;
 }
 
-void sse_remove_client(SSEContext* sse, int fd) {
-    pthread_mutex_lock(&sse->mutex);
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (sse_clients[i] == fd) {
-            sse_clients[i] = 0;
-            sse->client_count--;
-            break;
-        }
-    }
-    pthread_mutex_unlock(&sse->mutex);
+/* Called by a reactor before it drains, so a publish during the drain wakes it again. */
+void sse_woken(SSEContext* sse, int waker) {
+    uint64_t count;
+    ssize_t drained = read(sse->wake_fds[waker], &count, sizeof(count));
+    (void)drained;
+    atomic_store(&sse->wake_pending[waker], 0);
 }
 
-void sse_broadcast_canon(SSEContext* sse, uint32_t chunk_index, uint8_t matrix[7], float angle) {
-    char msg[512];
-    int len = snprintf(msg, sizeof(msg),
-        "event: canon\ndata: {\"chunk\":%u,\"matrix\":[%d,%d,%d,%d,%d,%d,%d],\"angle\":%.2f}\n\n",
-        chunk_index,
-        matrix[0], matrix[1], matrix[2], matrix[3],
-        matrix[4], matrix[5], matrix[6], angle);
+/* Called after the player publishes to the event log. */
+void sse_wake(SSEContext* sse) {
+    if (atomic_load_explicit(&sse->clients, memory_order_relaxed) == 0) return;
     
-    pthread_mutex_lock(&sse->mutex);
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (sse_clients[i] > 0) {
-            write(sse_clients[i], msg, len);
+    uint64_t one = 1;
+    for (int i = 0; i < sse->waker_count; i++) {
+        if (atomic_exchange(&sse->wake_pending[i], 1)) continue;
+        if (write(sse->wake_fds[i], &one, sizeof(one)) < 0) {
+            atomic_store(&sse->wake_pending[i], 0);
         }
     }
-    pthread_mutex_unlock(&sse->mutex);
 }
 
-void sse_broadcast_status(SSEContext* sse, uint32_t chunks, uint32_t current, uint8_t playing, float speed) {
-    char msg[256];
-    int len = snprintf(msg, sizeof(msg),
-        "event: status\ndata: {\"chunks\":%u,\"current\":%u,\"playing\":%d,\"speed\":%.1f}\n\n",
-        chunks, current, playing, speed);
+/* Response head for an event stream; there is no length, the stream ends with the connection. */
+size_t sse_preamble(char* out, size_t cap) {
+    int len = snprintf(out, cap,
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Connection: keep-alive\r\n"
+        "X-Accel-Buffering: no\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        "\r\n"
+        "retry: %d\n\n",
+        SSE_RETRY_MS);
+    return len > 0 && (size_t)len < cap ? (size_t)len : 0;
+}
+
+/*
+ * Finds where a reconnecting client left off: the Last-Event-ID header
+ * EventSource sends on its own (header, or NULL when absent), or
+ * lastEventId in the query for clients that reconnect by hand. Returns 1
+ * when one was given.
+ */
+int sse_last_event_id(const char* header, size_t header_len, const char* query, uint64_t* seq) {
+    if (header && header_len > 0) {
+        *seq = strtoull(header, NULL, 10);
+        return 1;
+    }
     
-    pthread_mutex_lock(&sse->mutex);
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (sse_clients[i] > 0) {
-            write(sse_clients[i], msg, len);
-        }
+    const char* param = query ? strstr(query, "lastEventId=") : NULL;
+    if (param && (param == query || param[-1] == '&' || param[-1] == '?')) {
+        *seq = strtoull(param + 12, NULL, 10);
+        return 1;
     }
-    pthread_mutex_unlock(&sse->mutex);
+    return 0;
 }
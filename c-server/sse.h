@@ -1,26 +1,39 @@
 #ifndef SSE_H
 #define SSE_H
 
-#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
+#include <stddef.h>
+#include "broadcast.h"
 
-#define SSE_MAX_CLIENTS 1000
+#define SSE_MAX_WAKERS 64
+#define SSE_HEARTBEAT_S 15
+#define SSE_RETRY_MS 2000
 
+/*
+ * Server-Sent Events fan-out. The player publishes shared frames into the
+ * event log; each reactor registers an eventfd and is woken at most once
+ * per burst to queue the frames it has not seen onto its own stream
+ * clients' output queues, by reference. Nothing is written to a socket
+ * outside the reactor that owns it, and the log doubles as the
+ * Last-Event-ID replay window for reconnecting clients.
+ */
 typedef struct {
-    int fd;
-    uint8_t active;
-} SSEClient;
-
-typedef struct {
-    int client_count;
-    pthread_mutex_t mutex;
+    BroadcastRing* log;
+    int wake_fds[SSE_MAX_WAKERS];
+    _Atomic uint8_t wake_pending[SSE_MAX_WAKERS];
+    int waker_count;
+    _Atomic uint64_t clients;
+    _Atomic uint64_t dropped;
 } SSEContext;
 
-int sse_init(SSEContext* sse);
+int sse_init(SSEContext* sse, BroadcastRing* log);
 void sse_shutdown(SSEContext* sse);
-int sse_add_client(SSEContext* sse, int fd);
-void sse_remove_client(SSEContext* sse, int fd);
-void sse_broadcast_canon(SSEContext* sse, uint32_t chunk_index, uint8_t matrix[7], float angle);
-void sse_broadcast_status(SSEContext* sse, uint32_t chunks, uint32_t current, uint8_t playing, float speed);
+int sse_add_waker(SSEContext* sse, int event_fd);
+void sse_woken(SSEContext* sse, int waker);
+void sse_wake(SSEContext* sse);
+
+size_t sse_preamble(char* out, size_t cap);
+int sse_last_event_id(const char* header, size_t header_len, const char* query, uint64_t* seq);
 
 #endif
@@ -2,47 +2,496 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <libwebsockets.h>
+#include "session.h"
+#include "router.h"
 
-static WSClient* ws_clients[WS_MAX_CLIENTS] = {0};
 static struct lws_context* ws_context = NULL;
+static WSContext* ws_state = NULL;
+/*
+ * Broadcasts arrive through the server's event log: the player thread
+ * publishes into it and wakes the lws service loop with lws_cancel_service.
+ * Everything that touches a connection then happens on the service thread,
+ * as libwebsockets requires: each client drains from its own read_seq one
+ * write per LWS_CALLBACK_SERVER_WRITEABLE, so a client with a full socket
+ * only falls behind itself.
+ */
+static BroadcastRing* ws_log = NULL;
+static struct lws_protocols ws_protocols[3];
+
+/* What each kind of client hears until it says otherwise. */
+typedef struct {
+    const char* name;
+    uint32_t interest;
+} WSRole;
+
+static const WSRole ws_roles[] = {
+    {"observer", BROADCAST_EVENTS_ALL | BROADCAST_POINT_ANY},
+    {"composer", BROADCAST_EVENTS_ALL | BROADCAST_POINT_ANY},
+    {"led", BROADCAST_EVENT_BIT(BROADCAST_CANON) | BROADCAST_POINT_ANY},
+};
+
+static const char* ws_event_names[] = { "canon", "status" };
+
+static int client_set_session(WSClient* client, const char* session, size_t len) {
+    if (len == 0 || len >= sizeof(client->session) || !session_id_valid(session, len)) return -1;
+    memcpy(client->session, session, len);
+    client->session[len] = '\0';
+    client->session_hash = broadcast_session_hash(client->session);
+    return 0;
+}
+
+static int client_set_role(WSClient* client, const char* role, size_t len) {
+    for (size_t i = 0; i < sizeof(ws_roles) / sizeof(ws_roles[0]); i++) {
+        if (strlen(ws_roles[i].name) == len && strncmp(ws_roles[i].name, role, len) == 0) {
+            snprintf(client->role, sizeof(client->role), "%s", ws_roles[i].name);
+            client->interest = ws_roles[i].interest;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Clients join a playback session by connecting to /session/<id>. */
+static void session_from_uri(struct lws* wsi, WSClient* client) {
+    char uri[128];
+    client_set_session(client, SESSION_DEFAULT, strlen(SESSION_DEFAULT));
+    if (lws_hdr_copy(wsi, uri, sizeof(uri), WSI_TOKEN_GET_URI) <= 0) return;
+    if (strncmp(uri, "/session/", 9) != 0 || uri[9] == '\0') return;
+    client_set_session(client, uri + 9, strcspn(uri + 9, "/?"));
+}
+
+static void client_resume(WSClient* client, const BroadcastResumeRequest* request) {
+    BroadcastResume resume;
+    broadcast_resume_plan(ws_log, client->session, broadcast_ring_head(ws_log), request, &resume);
+    client->read_seq = resume.read_seq;
+    client->snapshot_count = (uint8_t)resume.snapshot_count;
+    memcpy(client->snapshot, resume.snapshot, sizeof(client->snapshot));
+}
+
+/*
+ * The query picks the role (?role=led|composer|observer) and where to
+ * start: ?from=N, ?chunk=N and ?compact=1 pick up a replay.
+ */
+static void client_from_query(struct lws* wsi, WSClient* client) {
+    char args[128] = "";
+    BroadcastResumeRequest request = {0};
+    if (lws_hdr_copy(wsi, args, sizeof(args), WSI_TOKEN_HTTP_URI_ARGS) > 0) {
+        size_t role_len;
+        const char* role = query_param(args, "role", &role_len);
+        if (role) client_set_role(client, role, role_len);
+        broadcast_resume_parse(args, &request);
+    }
+    client_resume(client, &request);
+}
+
+/* Live frames: one AND settles type and Fano points, then session and chunk range. */
+static int client_wants(const WSClient* client, const BroadcastFrame* frame) {
+    if (!broadcast_interested(frame->interest, client->interest)) return 0;
+    if (frame->session_hash != client->session_hash || strcmp(frame->session, client->session) != 0) return 0;
+    return frame->chunk >= client->chunk_lo && frame->chunk <= client->chunk_hi;
+}
+
+/* Snapshot frames are the whole state, so only the event types and session count. */
+static int client_wants_state(const WSClient* client, const BroadcastFrame* frame) {
+    return (frame->interest & client->interest & BROADCAST_EVENTS_ALL) &&
+           frame->session_hash == client->session_hash && strcmp(frame->session, client->session) == 0;
+}
+
+/* Points just past "key": in a flat JSON object, or NULL. */
+static const char* json_value(const char* msg, const char* key) {
+    char pattern[32];
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+    const char* at = strstr(msg, pattern);
+    if (!at) return NULL;
+    at += strlen(pattern);
+    while (*at == ' ' || *at == '\t') at++;
+    if (*at != ':') return NULL;
+    at++;
+    while (*at == ' ' || *at == '\t') at++;
+    return at;
+}
+
+/* A JSON string value without escapes; returns its length or -1. */
+static int json_string(const char* value, const char** out) {
+    if (!value || *value != '"') return -1;
+    const char* end = strchr(value + 1, '"');
+    if (!end) return -1;
+    *out = value + 1;
+    return (int)(end - value - 1);
+}
+
+/* Numbers in a JSON array such as [0,3,5]; returns how many, or -1. */
+static int json_numbers(const char* value, uint32_t* out, int cap) {
+    if (!value || *value != '[') return -1;
+    int count = 0;
+    const char* at = value + 1;
+    while (*at && *at != ']') {
+        if (*at >= '0' && *at <= '9') {
+            char* end;
+            unsigned long n = strtoul(at, &end, 10);
+            if (count < cap) out[count] = (uint32_t)n;
+            count++;
+            at = end;
+        } else {
+            at++;
+        }
+    }
+    return *at == ']' ? count : -1;
+}
+
+/* Event type bits for ["canon","status"]. */
+static uint32_t json_events(const char* value) {
+    uint32_t bits = 0;
+    const char* end = value ? strchr(value, ']') : NULL;
+    if (!value || *value != '[' || !end) return 0;
+    for (int type = 0; type < (int)(sizeof(ws_event_names) / sizeof(ws_event_names[0])); type++) {
+        char quoted[16];
+        snprintf(quoted, sizeof(quoted), "\"%s\"", ws_event_names[type]);
+        const char* found = strstr(value, quoted);
+        if (found && found < end) bits |= BROADCAST_EVENT_BIT(type);
+    }
+    return bits;
+}
+
+/* Fano point bits for [0,3,5]; points outside 0-6 are ignored. */
+static uint32_t json_points(const char* value) {
+    uint32_t points[8];
+    int count = json_numbers(value, points, 8);
+    uint32_t bits = 0;
+    for (int i = 0; i < count && i < 8; i++) {
+        if (points[i] < 7) bits |= BROADCAST_POINT_BIT(points[i]);
+    }
+    return bits;
+}
+
+/*
+ * Control messages, one JSON object per text message:
+ *   {"type":"subscribe","role":"led","events":["canon"],"points":[0,3],
+ *    "chunks":[10,200],"session":"id"}
+ *   {"type":"unsubscribe","events":["status"],"points":[3]}
+ *   {"type":"replay","from":N} or {"type":"replay","chunk":N,"compact":1}
+ * subscribe applies the role's defaults first, then replaces whichever of
+ * events, points ([] for all), chunks and session it names; unsubscribe
+ * removes the events and points it names, or everything when it names
+ * none. The bare words subscribe and unsubscribe mean all and nothing.
+ * Every message is answered with the resulting subscription.
+ */
+static void client_control(WSClient* client, const char* msg) {
+    const char* type = NULL;
+    int type_len = json_string(json_value(msg, "type"), &type);
+    client->ack = WS_ACK_SUBSCRIPTION;
+    
+    if (strcmp(msg, "subscribe") == 0) {
+        client_set_role(client, client->role, strlen(client->role));
+        client->chunk_lo = 0;
+        client->chunk_hi = UINT32_MAX;
+    } else if (strcmp(msg, "unsubscribe") == 0) {
+        client->interest = 0;
+    } else if (type_len == 9 && strncmp(type, "subscribe", 9) == 0) {
+        const char* value;
+        const char* text;
+        int len;
+        if ((len = json_string(json_value(msg, "role"), &text)) < 0) {
+            text = client->role;
+            len = (int)strlen(client->role);
+        }
+        if (client_set_role(client, text, (size_t)len) < 0) {
+            client->ack = WS_ACK_ERROR;
+            return;
+        }
+        if ((value = json_value(msg, "events")) != NULL) {
+            client->interest = (client->interest & ~BROADCAST_EVENTS_ALL) | json_events(value);
+        }
+        if ((value = json_value(msg, "points")) != NULL) {
+            uint32_t points = json_points(value);
+            client->interest = (client->interest & ~(BROADCAST_POINTS_ALL | BROADCAST_POINT_ANY)) |
+                               (points ? points : BROADCAST_POINT_ANY);
+        }
+        uint32_t range[2];
+        if (json_numbers(json_value(msg, "chunks"), range, 2) == 2 && range[0] <= range[1]) {
+            client->chunk_lo = range[0];
+            client->chunk_hi = range[1];
+        }
+        if ((len = json_string(json_value(msg, "session"), &text)) >= 0) {
+            if (client_set_session(client, text, (size_t)len) < 0) {
+                client->ack = WS_ACK_ERROR;
+                return;
+            }
+            /* A new session starts from its current state. */
+            BroadcastResumeRequest request = {0};
+            client_resume(client, &request);
+        }
+    } else if (type_len == 11 && strncmp(type, "unsubscribe", 11) == 0) {
+        const char* events = json_value(msg, "events");
+        const char* points = json_value(msg, "points");
+        if (!events && !points) client->interest = 0;
+        if (events) client->interest &= ~json_events(events);
+        if (points) {
+            if (client->interest & BROADCAST_POINT_ANY) {
+                client->interest = (client->interest & ~BROADCAST_POINT_ANY) | BROADCAST_POINTS_ALL;
+            }
+            client->interest &= ~json_points(points);
+        }
+    } else if (type_len == 6 && strncmp(type, "replay", 6) == 0) {
+        BroadcastResumeRequest request = {0};
+        const char* value;
+        if ((value = json_value(msg, "from")) != NULL) {
+            request.resuming = 1;
+            request.from = strtoull(value, NULL, 10);
+        }
+        if ((value = json_value(msg, "chunk")) != NULL) {
+            request.by_chunk = 1;
+            request.chunk = (uint32_t)strtoul(value, NULL, 10);
+        }
+        if ((value = json_value(msg, "compact")) != NULL) {
+            request.compact = *value == '1' || *value == 't';
+        }
+        client_resume(client, &request);
+    } else {
+        client->ack = WS_ACK_ERROR;
+        return;
+    }
+    client->subscribed = client->interest != 0;
+}
+
+static int client_send_ack(struct lws* wsi, WSClient* client) {
+    static unsigned char buf[LWS_PRE + 512];
+    char* msg = (char*)buf + LWS_PRE;
+    size_t cap = sizeof(buf) - LWS_PRE;
+    int len;
+    
+    if (client->ack == WS_ACK_ERROR) {
+        len = snprintf(msg, cap, "{\"type\":\"error\",\"message\":\"unrecognised control message\"}");
+    } else {
+        len = snprintf(msg, cap, "{\"type\":\"subscription\",\"role\":\"%s\",\"session\":\"%s\",\"events\":[",
+                       client->role, client->session);
+        int first = 1;
+        for (int type = 0; type < (int)(sizeof(ws_event_names) / sizeof(ws_event_names[0])); type++) {
+            if (!(client->interest & BROADCAST_EVENT_BIT(type))) continue;
+            len += snprintf(msg + len, cap - len, "%s\"%s\"", first ? "" : ",", ws_event_names[type]);
+            first = 0;
+        }
+        len += snprintf(msg + len, cap - len, "],\"points\":[");
+        first = 1;
+        for (int point = 0; point < 7; point++) {
+            if (!(client->interest & (BROADCAST_POINT_BIT(point) | BROADCAST_POINT_ANY))) continue;
+            len += snprintf(msg + len, cap - len, "%s%d", first ? "" : ",", point);
+            first = 0;
+        }
+        len += snprintf(msg + len, cap - len, "],\"chunks\":[%u,%u]}", client->chunk_lo, client->chunk_hi);
+    }
+    client->ack = WS_ACK_NONE;
+    return lws_write(wsi, (unsigned char*)msg, (size_t)len, LWS_WRITE_TEXT) < len ? -1 : 0;
+}
+
+/* lws_write fills the LWS_PRE headroom; only this thread writes frames. */
+static int client_send_frame(struct lws* wsi, WSClient* client, const BroadcastFrame* frame) {
+    int len;
+    int written;
+    if (client->binary) {
+        len = (int)frame->bin_len;
+        written = lws_write(wsi, frame->bin, (size_t)len, LWS_WRITE_BINARY);
+    } else {
+        len = (int)frame->json_len;
+        written = lws_write(wsi, frame->json, (size_t)len, LWS_WRITE_TEXT);
+    }
+    return written < len ? -1 : 0;
+}
+
+/*
+ * fano-bin clients that are behind get every pending canon record of their
+ * session packed into one message. Status records in between are
+ * superseded by later ones, so only the newest is kept and it goes out on
+ * its own afterwards. Returns 1 when a batch was written, 0 when there was
+ * nothing to batch and -1 when the write failed.
+ */
+static int client_send_batch(struct lws* wsi, WSClient* client, uint64_t head) {
+    static unsigned char batch[LWS_PRE + BROADCAST_BIN_HEADER + BROADCAST_BIN_RECORD * WS_BIN_BATCH];
+    unsigned char* message = batch + LWS_PRE;
+    unsigned char* records = message + BROADCAST_BIN_HEADER;
+    uint16_t count = 0;
+    
+    while (client->read_seq < head && count < WS_BIN_BATCH) {
+        uint64_t seq = client->read_seq + 1;
+        BroadcastFrame* frame = broadcast_ring_acquire(ws_log, seq);
+        if (frame && client_wants(client, frame)) {
+            if (frame->type == BROADCAST_STATUS && seq == head) {
+                broadcast_release(frame);
+                break;
+            }
+            if (frame->type == BROADCAST_CANON) {
+                memcpy(records + (size_t)count * BROADCAST_BIN_RECORD,
+                       broadcast_bin_record(frame), BROADCAST_BIN_RECORD);
+                count++;
+            }
+        }
+        broadcast_release(frame);
+        client->read_seq++;
+    }
+    if (count == 0) return 0;
+    
+    broadcast_bin_header(message, BROADCAST_CANON, count);
+    int len = BROADCAST_BIN_HEADER + count * BROADCAST_BIN_RECORD;
+    if (lws_write(wsi, message, (size_t)len, LWS_WRITE_BINARY) < len) return -1;
+    atomic_fetch_add(&ws_state->batched, count);
+    return 1;
+}
+
+/* Sends the next message for this client; one lws_write per writeable callback. */
+static int client_drain(struct lws* wsi, WSClient* client) {
+    uint64_t head = broadcast_ring_head(ws_log);
+    
+    /* Too far behind: skip to the current state rather than replay history. */
+    if (head - client->read_seq > WS_COALESCE_LAG) {
+        if (++client->coalesces > WS_MAX_COALESCES) {
+            atomic_fetch_add(&ws_state->dropped, 1);
+            printf("WebSocket client dropped: cannot keep up\n");
+            return -1;
+        }
+        atomic_fetch_add(&ws_state->coalesced, head - client->read_seq);
+        client->read_seq = head;
+        client->snapshot_count = (uint8_t)broadcast_ring_latest(ws_log, client->session, head, client->snapshot);
+    }
+    
+    int sent = 0;
+    if (client->ack) {
+        if (client_send_ack(wsi, client) < 0) return -1;
+        sent = 1;
+    }
+    while (client->snapshot_count && !sent) {
+        BroadcastFrame* frame = broadcast_ring_acquire(ws_log, client->snapshot[0]);
+        client->snapshot[0] = client->snapshot[1];
+        client->snapshot_count--;
+        if (!frame) continue;
+        if (!client_wants_state(client, frame)) {
+            broadcast_release(frame);
+            continue;
+        }
+        int rc = client_send_frame(wsi, client, frame);
+        broadcast_release(frame);
+        if (rc < 0) return -1;
+        sent = 1;
+    }
+    
+    if (!sent && client->binary && head - client->read_seq > 2) {
+        sent = client_send_batch(wsi, client, head);
+        if (sent < 0) return -1;
+    }
+    
+    while (!sent && client->read_seq < head) {
+        BroadcastFrame* frame = broadcast_ring_acquire(ws_log, ++client->read_seq);
+        if (!frame) continue;
+        if (!client_wants(client, frame)) {
+            broadcast_release(frame);
+            continue;
+        }
+        int rc = client_send_frame(wsi, client, frame);
+        broadcast_release(frame);
+        if (rc < 0) return -1;
+        sent = 1;
+    }
+    if (client->ack || client->snapshot_count || client->read_seq < head) {
+        lws_callback_on_writable(wsi);
+    } else {
+        client->coalesces = 0;
+    }
+    return 0;
+}
+
+/*
+ * Connected clients, threaded through their own lws per-session storage:
+ * no allocation and no scan to join or leave.
+ */
+static void client_link(WSClient* client) {
+    client->prev = NULL;
+    client->next = ws_state->clients;
+    if (client->next) client->next->prev = client;
+    ws_state->clients = client;
+    atomic_fetch_add_explicit(&ws_state->client_count, 1, memory_order_relaxed);
+}
+
+static void client_unlink(WSClient* client) {
+    /* CLOSED also arrives for connections that never reached ESTABLISHED. */
+    if (!client->wsi) return;
+    if (client->prev) client->prev->next = client->next;
+    else ws_state->clients = client->next;
+    if (client->next) client->next->prev = client->prev;
+    client->prev = client->next = NULL;
+    client->wsi = NULL;
+    atomic_fetch_sub_explicit(&ws_state->client_count, 1, memory_order_relaxed);
+}
+
+/*
+ * lws sizes its connection table from the descriptor limit when the
+ * context is created, so lift the soft limit to the hard one first.
+ */
+static void raise_fd_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) < 0 || limit.rlim_cur >= limit.rlim_max) return;
+    limit.rlim_cur = limit.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &limit) < 0) {
+        perror("setrlimit");
+        return;
+    }
+    printf("File descriptor limit raised to %lu\n", (unsigned long)limit.rlim_cur);
+}
 
 static int ws_callback(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len) {
-    (void)user;
-    (void)len;
+    WSClient* client = (WSClient*)user;
     
     switch (reason) {
         case LWS_CALLBACK_ESTABLISHED: {
             printf("WebSocket client connected\n");
-            for (int i = 0; i < WS_MAX_CLIENTS; i++) {
-                if (!ws_clients[i]) {
-                    ws_clients[i] = (WSClient*)malloc(sizeof(WSClient));
-                    ws_clients[i]->wsi = wsi;
-                    ws_clients[i]->subscribed = 1;
-                    strcpy(ws_clients[i]->role, "observer");
-                    break;
-                }
+            memset(client, 0, sizeof(*client));
+            client->wsi = wsi;
+            client->binary = lws_get_protocol(wsi) == &ws_protocols[WS_PROTOCOL_BIN];
+            client_set_role(client, "observer", 8);
+            client->chunk_hi = UINT32_MAX;
+            session_from_uri(wsi, client);
+            client_from_query(wsi, client);
+            client->subscribed = client->interest != 0;
+            if (client->snapshot_count || client->read_seq < broadcast_ring_head(ws_log)) {
+                lws_callback_on_writable(wsi);
             }
+            client_link(client);
             break;
         }
         
         case LWS_CALLBACK_CLOSED: {
             printf("WebSocket client disconnected\n");
-            for (int i = 0; i < WS_MAX_CLIENTS; i++) {
-                if (ws_clients[i] && ws_clients[i]->wsi == wsi) {
-                    free(ws_clients[i]);
-                    ws_clients[i] = NULL;
-                    break;
-                }
-            }
+            client_unlink(client);
             break;
         }
         
         case LWS_CALLBACK_RECEIVE: {
-            printf("WebSocket received: %s\n", (char*)in);
+            /* Control messages may arrive in fragments; act on complete ones. */
+            if (lws_is_first_fragment(wsi)) client->rx_len = 0;
+            size_t room = sizeof(client->rx) - 1 - client->rx_len;
+            size_t take = len < room ? len : room;
+            memcpy(client->rx + client->rx_len, in, take);
+            client->rx_len += (uint16_t)take;
+            if (!lws_is_final_fragment(wsi) || lws_remaining_packet_payload(wsi) > 0) break;
+            
+            client->rx[client->rx_len] = '\0';
+            client_control(client, client->rx);
+            client->rx_len = 0;
+            lws_callback_on_writable(wsi);
             break;
         }
         
+        case LWS_CALLBACK_EVENT_WAIT_CANCELLED: {
+            /* The player published something: let every connection drain. */
+            lws_callback_on_writable_all_protocol(ws_context, &ws_protocols[WS_PROTOCOL_JSON]);
+            lws_callback_on_writable_all_protocol(ws_context, &ws_protocols[WS_PROTOCOL_BIN]);
+            break;
+        }
+        
+        case LWS_CALLBACK_SERVER_WRITEABLE: {
+            return client_drain(wsi, client);
+        }
+        
         default:
             break;
     }
@@ -50,12 +499,21 @@ static int ws_callback(struct lws* wsi, enum lws_callback_reasons reason, void*
     return 0;
 }
 
-static struct lws_protocols ws_protocols[] = {
+static struct lws_protocols ws_protocols[3] = {
     {"fano-protocol", ws_callback, sizeof(WSClient), 4096},
+    {"fano-bin", ws_callback, sizeof(WSClient), 4096},
     {NULL, NULL, 0, 0}
 };
 
-int ws_init(WSContext* ws, int port) {
+static void* ws_service_thread(void* arg) {
+    WSContext* ws = (WSContext*)arg;
+    while (ws->running) {
+        lws_service(ws->context, 50);
+    }
+    return NULL;
+}
+
+int ws_init(WSContext* ws, int port, BroadcastRing* log) {
     struct lws_context_creation_info info;
     memset(&info, 0, sizeof(info));
     
@@ -63,66 +521,49 @@ int ws_init(WSContext* ws, int port) {
     info.protocols = ws_protocols;
     info.options = LWS_SERVER_OPTION_VALIDATE_UTF8;
     
+    raise_fd_limit();
     ws_context = lws_create_context(&info);
     if (!ws_context) {
         fprintf(stderr, "Failed to create WebSocket context\n");
         return -1;
     }
     
-    memset(ws_clients, 0, sizeof(ws_clients));
+    ws_log = log;
     ws->context = ws_context;
-    ws->client_count = 0;
-    pthread_mutex_init(&ws->mutex, NULL);
+    ws->clients = NULL;
+    atomic_init(&ws->client_count, 0);
+    atomic_init(&ws->dropped, 0);
+    atomic_init(&ws->coalesced, 0);
+    atomic_init(&ws->batched, 0);
+    ws_state = ws;
     
-    printf("WebSocket server initialized on port %d\n", port);
-    return 0;
-}
-
-void ws_shutdown(WSContext* ws) {
-    (void)ws;
-    if (ws_context) {
+    ws->running = 1;
+    if (pthread_create(&ws->thread, NULL, ws_service_thread, ws) != 0) {
+        fprintf(stderr, "Failed to start WebSocket service thread\n");
+        ws->running = 0;
         lws_context_destroy(ws_context);
         ws_context = NULL;
+        ws->context = NULL;
+        return -1;
     }
-    pthread_mutex_destroy(&ws->mutex);
-}
-
-void ws_broadcast_canon(WSContext* ws, uint32_t chunk_index, uint8_t matrix[7], float angle) {
-    char msg[512];
-    int len = snprintf(msg, sizeof(msg),
-        "{\"type\":\"canon\",\"chunk\":%u,\"matrix\":[%d,%d,%d,%d,%d,%d,%d],\"angle\":%.2f}",
-        chunk_index,
-        matrix[0], matrix[1], matrix[2], matrix[3],
-        matrix[4], matrix[5], matrix[6], angle);
     
-    pthread_mutex_lock(&ws->mutex);
-    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
-        if (ws_clients[i] && ws_clients[i]->subscribed) {
-            lws_write(ws_clients[i]->wsi, (unsigned char*)msg, len, LWS_WRITE_TEXT);
-        }
-    }
-    pthread_mutex_unlock(&ws->mutex);
+    printf("WebSocket server initialized on port %d\n", port);
+    return 0;
 }
 
-void ws_broadcast_status(WSContext* ws, uint32_t chunks, uint32_t current, uint8_t playing, float speed) {
-    char msg[256];
-    int len = snprintf(msg, sizeof(msg),
-        "{\"type\":\"status\",\"chunks\":%u,\"current\":%u,\"playing\":%d,\"speed\":%.1f}",
-        chunks, current, playing, speed);
-    
-    pthread_mutex_lock(&ws->mutex);
-    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
-        if (ws_clients[i] && ws_clients[i]->subscribed) {
-            lws_write(ws_clients[i]->wsi, (unsigned char*)msg, len, LWS_WRITE_TEXT);
-        }
-    }
-    pthread_mutex_unlock(&ws->mutex);
+/* Wakes the service loop out of lws_service so it sees running drop, then joins it. */
+void ws_shutdown(WSContext* ws) {
+    if (!ws_context) return;
+    ws->running = 0;
+    lws_cancel_service(ws_context);
+    pthread_join(ws->thread, NULL);
+    lws_context_destroy(ws_context);
+    ws_context = NULL;
+    ws->context = NULL;
 }
 
-void* ws_service_thread(void* arg) {
-    WSContext* ws = (WSContext*)arg;
-    while (ws->context) {
-        lws_service(ws->context, 50);
-    }
-    return NULL;
+/* Called after the player publishes to the event log. */
+void ws_wake(WSContext* ws) {
+    (void)ws;
+    if (ws_context) lws_cancel_service(ws_context);
 }
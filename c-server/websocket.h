@@ -3,27 +3,69 @@
 
 #include <libwebsockets.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
+#include "broadcast.h"
 
-#define WS_MAX_CLIENTS 100
+#define WS_SESSION_ID_MAX 32
+#define WS_COALESCE_LAG 64
+#define WS_MAX_COALESCES 32
+#define WS_BIN_BATCH 64
+#define WS_CONTROL_MAX 256
 
-typedef struct {
+/* Index into the protocol table; fano-bin carries BROADCAST_BIN_* messages. */
+#define WS_PROTOCOL_JSON 0
+#define WS_PROTOCOL_BIN 1
+
+/* Replies owed to a client after a control message. */
+#define WS_ACK_NONE 0
+#define WS_ACK_SUBSCRIPTION 1
+#define WS_ACK_ERROR 2
+
+/*
+ * Per-connection state; lives in the lws per-session user area. What a
+ * client hears is interest (BROADCAST_EVENT_BIT/POINT_BIT mask, seeded
+ * from its role), its session and an inclusive chunk range.
+ */
+typedef struct WSClient {
     struct lws* wsi;
     uint8_t subscribed;
+    uint8_t binary;
+    uint8_t ack;
     char role[16];
+    char session[WS_SESSION_ID_MAX];
+    uint32_t session_hash;
+    uint32_t interest;
+    uint32_t chunk_lo;
+    uint32_t chunk_hi;
+    uint64_t read_seq;  /* last frame seq handled */
+    uint64_t snapshot[2];
+    uint8_t snapshot_count;
+    uint32_t coalesces;
+    uint16_t rx_len;
+    char rx[WS_CONTROL_MAX];
+    struct WSClient* prev;
+    struct WSClient* next;
 } WSClient;
 
+/*
+ * The lws context and the thread that services it. ws_init starts the
+ * thread; ws_shutdown stops and joins it before destroying the context,
+ * so nothing touches the event log or the sessions once it returns.
+ */
 typedef struct {
     struct lws_context* context;
-    WSClient* clients[WS_MAX_CLIENTS];
-    int client_count;
-    pthread_mutex_t mutex;
+    pthread_t thread;
+    volatile uint8_t running;
+    WSClient* clients;              /* service thread only */
+    _Atomic int client_count;
+    _Atomic uint64_t dropped;
+    _Atomic uint64_t coalesced;
+    _Atomic uint64_t batched;
 } WSContext;
 
-int ws_init(WSContext* ws, int port);
+int ws_init(WSContext* ws, int port, BroadcastRing* log);
 void ws_shutdown(WSContext* ws);
-void ws_broadcast_canon(WSContext* ws, uint32_t chunk_index, uint8_t matrix[7], float angle);
-void ws_broadcast_status(WSContext* ws, uint32_t chunks, uint32_t current, uint8_t playing, float speed);
-void* ws_service_thread(void* arg);
+void ws_wake(WSContext* ws);
 
 #endif